@@ -0,0 +1,127 @@
+#include "krs_arena.h"
+#include "krs_types.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_BLOCK_SIZE 4096
+#define ARENA_ALIGN (sizeof(max_align_t))
+#define ARENA_SIZE_LIMIT (SIZE_MAX / 4)
+
+struct arena_block
+{
+    struct arena_block *prev;
+    size_t cap;
+    size_t used;
+    // Offset of the last allocation
+    size_t last;
+    max_align_t data[];
+};
+
+static size_t arena_align_up(size_t const n)
+{
+    return (n + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+static void arena_free_blocks(struct arena_block *block)
+{
+    while (block)
+    {
+        struct arena_block *const prev = block->prev;
+        free(block);
+        block = prev;
+    }
+}
+
+void arena_deinit(struct arena *const arena)
+{
+    arena_free_blocks(arena->block);
+    arena->block = NULL;
+}
+
+void arena_reset(struct arena *const arena)
+{
+    struct arena_block *const block = arena->block;
+
+    if (block)
+    {
+        arena_free_blocks(block->prev);
+        block->prev = NULL;
+        block->used = 0;
+        block->last = 0;
+    }
+}
+
+void *arena_alloc(struct arena *const arena, size_t const size)
+{
+    void *ptr = NULL;
+
+    if (size > ARENA_SIZE_LIMIT)
+    {
+        goto done;
+    }
+
+    struct arena_block *block = arena->block;
+    size_t start = block ? arena_align_up(block->used) : 0;
+
+    if (!block || start > block->cap || size > block->cap - start)
+    {
+        // Blocks double, so a reset arena soon stops allocating
+        size_t cap = block ? block->cap * 2 : ARENA_MIN_BLOCK_SIZE;
+        while (cap < size)
+        {
+            cap *= 2;
+        }
+
+        struct arena_block *const next = malloc(sizeof(*next) + cap);
+        if (!next)
+        {
+            goto done;
+        }
+
+        *next = (struct arena_block){
+            .prev = block,
+            .cap = cap,
+        };
+        arena->block = block = next;
+        start = 0;
+    }
+
+    block->last = start;
+    block->used = start + size;
+    ptr = (unsigned char *)block->data + start;
+
+done:
+    return ptr;
+}
+
+void *arena_realloc(
+    struct arena *const arena,
+    void *const ptr,
+    size_t const old_size,
+    size_t const new_size
+)
+{
+    void *new_ptr;
+    struct arena_block *const block = arena->block;
+
+    if (ptr && ptr == (unsigned char *)block->data + block->last &&
+        new_size <= block->cap - block->last)
+    {
+        block->used = block->last + new_size;
+        new_ptr = ptr;
+    }
+    else
+    {
+        new_ptr = arena_alloc(arena, new_size);
+        if (new_ptr && ptr)
+        {
+            memcpy(new_ptr, ptr, MIN(old_size, new_size));
+        }
+    }
+
+    return new_ptr;
+}
@@ -0,0 +1,33 @@
+#ifndef KRS_ARENA_H_
+#define KRS_ARENA_H_
+
+#include "krs_cc_ext.h"
+#include <stddef.h>
+
+struct arena_block;
+
+// Bump allocator. Allocations are not freed one by one, but all at once by
+// `arena_reset()` or `arena_deinit()`.
+struct arena
+{
+    // Block allocations come from, linked to the blocks before it
+    struct arena_block *block;
+};
+
+void arena_deinit(struct arena *arena);
+
+// Release all allocations, keeping the newest (largest) block for reuse
+void arena_reset(struct arena *arena);
+
+nodiscard void *arena_alloc(struct arena *arena, size_t size);
+
+// Resize `ptr`, an allocation of `old_size` bytes, or allocate if NULL.
+// The last allocation grows in place while its block has room.
+nodiscard void *arena_realloc(
+    struct arena *arena,
+    void *ptr,
+    size_t old_size,
+    size_t new_size
+);
+
+#endif
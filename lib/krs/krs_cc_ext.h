@@ -3,8 +3,12 @@
 
 #if defined(__GNUC__) || defined(__clang__)
 #define nodiscard __attribute__((warn_unused_result))
+// Check arguments from `first_arg` against the printf format `fmt_index`
+#define printf_format(fmt_index, first_arg)                                    \
+    __attribute__((format(printf, fmt_index, first_arg)))
 #else
 #define nodiscard
+#define printf_format(fmt_index, first_arg)
 #endif
 
 #endif
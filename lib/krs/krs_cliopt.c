@@ -1,4 +1,5 @@
 #include "krs_cliopt.h"
+#include "krs_arena.h"
 #include "krs_dynamic_array.h"
 #include "krs_log.h"
 #include "krs_str.h"
@@ -24,6 +25,7 @@ static nodiscard bool expects_arg(struct cliopt_meta const *meta)
         break;
     case CLIOPT_STRING:
     case CLIOPT_INT:
+    case CLIOPT_STRINGS:
         out = true;
         break;
     case CLIOPT_NONE:
@@ -40,6 +42,11 @@ static nodiscard bool is_positional_arg(struct cliopt const *const opt)
     return opt->name && (opt->name[0] != '-') && (opt->short_name == '\0');
 }
 
+static nodiscard bool is_repeatable(struct cliopt_meta const *meta)
+{
+    return meta->kind == CLIOPT_STRINGS;
+}
+
 static nodiscard bool is_long_arg(struct cliopt const *const opt)
 {
     return opt->name && (opt->name[0] == '-') && (opt->name[1] == '-') &&
@@ -52,7 +59,7 @@ static nodiscard bool parse_arg_value( //
 )
 {
     assert(arg);
-    assert(!meta->used);
+    assert(!meta->used || is_repeatable(meta));
     assert(meta->output);
 
     bool ok;
@@ -98,6 +105,15 @@ static nodiscard bool parse_arg_value( //
         }
     }
     break;
+    case CLIOPT_STRINGS:
+    {
+        ok = da_push((struct cliopt_strs *)meta->output, &arg);
+        if (!ok)
+        {
+            klog(LL_ERROR, "Out of memory");
+        }
+    }
+    break;
     default:
     {
         assert(false);
@@ -120,7 +136,8 @@ static bool nodiscard get_next_positional( //
     for (u32 i = 0; i < opts.len; ++i)
     {
         struct cliopt_meta *const meta = &opts.ptr[i];
-        if (!meta->used && is_positional_arg(&meta->spec))
+        if ((!meta->used || is_repeatable(meta)) &&
+            is_positional_arg(&meta->spec))
         {
             *out = meta;
             ok = true;
@@ -160,7 +177,7 @@ static bool get_short( //
     {
         klog(LL_ERROR, "Unrecognized option '-%c'", short_name);
     }
-    else if ((*out)->used)
+    else if ((*out)->used && !is_repeatable(*out))
     {
         klog(LL_ERROR, "Option '-%c' already used", short_name);
         ok = false;
@@ -198,7 +215,7 @@ static bool get_long( //
             str_format_args(long_name)
         );
     }
-    else if ((*out)->used)
+    else if ((*out)->used && !is_repeatable(*out))
     {
         klog(
             LL_ERROR,
@@ -246,9 +263,12 @@ bool cliopt_print_usage(
 
         if (is_positional_arg(&spec))
         {
+            char const *const ellipsis =
+                is_repeatable(&opts.ptr[i]) ? "..." : "";
+
             if (spec.required)
             {
-                cstrbuf_snprintf(&ok, &usage, N, "%s ", spec.name);
+                cstrbuf_snprintf(&ok, &usage, N, "%s%s ", spec.name, ellipsis);
                 if (!ok)
                 {
                     goto done;
@@ -256,7 +276,14 @@ bool cliopt_print_usage(
             }
             else
             {
-                cstrbuf_snprintf(&ok, &usage, N, "[%s] ", spec.name);
+                cstrbuf_snprintf(
+                    &ok,
+                    &usage,
+                    N,
+                    "[%s%s] ",
+                    spec.name,
+                    ellipsis
+                );
                 if (!ok)
                 {
                     goto done;
@@ -320,6 +347,8 @@ bool cliopt_print_help(struct cliopt_options const opts)
     bool ok = true;
     struct optstrs pos_lines = {0};
     struct optstrs opt_lines = {0};
+    // Backs every line, so they are freed together
+    struct arena arena = {0};
 
     for (size_t i = 0; i < opts.len; ++i)
     {
@@ -334,7 +363,7 @@ bool cliopt_print_help(struct cliopt_options const opts)
             {
                 goto done;
             }
-            *line = (struct cstrbuf){0};
+            *line = (struct cstrbuf){.arena = &arena};
 
             ok = cstrbuf_extend_cstr(line, spec.name);
             if (!ok)
@@ -356,7 +385,7 @@ bool cliopt_print_help(struct cliopt_options const opts)
             {
                 goto done;
             }
-            *line = (struct cstrbuf){0};
+            *line = (struct cstrbuf){.arena = &arena};
 
             if (spec.short_name)
             {
@@ -498,16 +527,9 @@ bool cliopt_print_help(struct cliopt_options const opts)
     }
 
 done:
-    for (size_t i = 0; i < pos_lines.len; ++i)
-    {
-        cstrbuf_deinit(&pos_lines.ptr[i]);
-    }
     da_deinit(&pos_lines);
-    for (size_t i = 0; i < opt_lines.len; ++i)
-    {
-        cstrbuf_deinit(&opt_lines.ptr[i]);
-    }
     da_deinit(&opt_lines);
+    arena_deinit(&arena);
 
     return ok;
 }
@@ -12,6 +12,15 @@ enum cliopt_kind
     CLIOPT_BOOL,
     CLIOPT_STRING,
     CLIOPT_INT,
+    CLIOPT_STRINGS,
+};
+
+// Repeatable string argument (e.g. variadic positional args)
+struct cliopt_strs
+{
+    char const **ptr;
+    size_t len;
+    size_t cap;
 };
 
 struct cliopt
@@ -68,7 +77,8 @@ prexy_tag(cliopt_from_args);
             (cli_data->varname),                                               \
             bool: CLIOPT_BOOL,                                                 \
             char const *: CLIOPT_STRING,                                       \
-            i64: CLIOPT_INT                                                    \
+            i64: CLIOPT_INT,                                                   \
+            struct cliopt_strs: CLIOPT_STRINGS                                 \
         ),                                                                     \
         .ident_name = #varname,                                                \
         .output = &cli_data->varname,                                          \
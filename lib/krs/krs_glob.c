@@ -0,0 +1,404 @@
+#include "krs_glob.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+struct char_class
+{
+    char const *name;
+    int (*is)(int c);
+};
+
+static struct char_class const char_classes[] = {
+    {"alnum", isalnum},
+    {"alpha", isalpha},
+    {"blank", isblank},
+    {"cntrl", iscntrl},
+    {"digit", isdigit},
+    {"graph", isgraph},
+    {"lower", islower},
+    {"print", isprint},
+    {"punct", ispunct},
+    {"space", isspace},
+    {"upper", isupper},
+    {"xdigit", isxdigit},
+};
+
+static void byteset_add(struct glob_byteset *const set, unsigned char const c)
+{
+    set->bits[c >> 6] |= (u64)1 << (c & 63);
+}
+
+static void byteset_add_range( //
+    struct glob_byteset *const set,
+    unsigned char const lo,
+    unsigned char const hi
+)
+{
+    for (unsigned c = lo; c <= hi; ++c)
+    {
+        byteset_add(set, (unsigned char)c);
+    }
+}
+
+static void byteset_invert(struct glob_byteset *const set)
+{
+    for (size_t i = 0; i < ARRAY_LENGTH(set->bits); ++i)
+    {
+        set->bits[i] = ~set->bits[i];
+    }
+}
+
+// Find `close` (e.g. ":]") at or after `i`. Returns `pattern.len` if missing.
+static size_t find_bracket_close( //
+    struct sv const pattern,
+    size_t i,
+    char const close
+)
+{
+    for (; i + 1 < pattern.len; ++i)
+    {
+        if (pattern.ptr[i] == close && pattern.ptr[i + 1] == ']')
+        {
+            return i;
+        }
+    }
+    return pattern.len;
+}
+
+enum bracket_result
+{
+    BRACKET_OK,
+    // No closing ']', so '[' is a literal
+    BRACKET_UNTERMINATED,
+    BRACKET_UNSUPPORTED,
+};
+
+// True if `[` at `i` starts `[:`, `[=` or `[.`
+static bool is_bracket_special(struct sv const pattern, size_t const i)
+{
+    return pattern.ptr[i] == '[' && i + 1 < pattern.len &&
+           memchr(":=.", pattern.ptr[i + 1], 3);
+}
+
+// Parse one bracket expression element (`c`, `\c`, `[.c.]` or `[=c=]`)
+// at `*i`. Character classes are handled by the caller. glibc is not
+// consistent about an equivalence class as a range end, so it is rejected.
+static enum bracket_result parse_bracket_char(
+    struct sv const pattern,
+    size_t *const i,
+    bool const range_end,
+    unsigned char *const out
+)
+{
+    enum bracket_result result = BRACKET_OK;
+    size_t j = *i;
+
+    if (j >= pattern.len)
+    {
+        result = BRACKET_UNTERMINATED;
+    }
+    else if (pattern.ptr[j] == '\\')
+    {
+        if (j + 1 < pattern.len)
+        {
+            *out = (unsigned char)pattern.ptr[j + 1];
+            j += 2;
+        }
+        else
+        {
+            result = BRACKET_UNTERMINATED;
+        }
+    }
+    else if (is_bracket_special(pattern, j))
+    {
+        char const kind = pattern.ptr[j + 1];
+        size_t const end = find_bracket_close(pattern, j + 2, kind);
+
+        // Only single character `[.c.]` and `[=c=]` are supported
+        if (kind == ':' || (range_end && kind == '=') ||
+            end == pattern.len || end != j + 3)
+        {
+            result = BRACKET_UNSUPPORTED;
+        }
+        else
+        {
+            *out = (unsigned char)pattern.ptr[j + 2];
+            j = end + 2;
+        }
+    }
+    else
+    {
+        *out = (unsigned char)pattern.ptr[j];
+        j += 1;
+    }
+
+    *i = j;
+    return result;
+}
+
+// Parse a bracket expression starting at `*i` (the '[')
+static enum bracket_result parse_bracket(
+    struct sv const pattern,
+    size_t *const i,
+    struct glob_byteset *const set
+)
+{
+    enum bracket_result result = BRACKET_OK;
+    size_t j = *i + 1;
+    bool negate = false;
+
+    *set = (struct glob_byteset){0};
+
+    if (j < pattern.len && (pattern.ptr[j] == '!' || pattern.ptr[j] == '^'))
+    {
+        negate = true;
+        ++j;
+    }
+
+    // glibc reads `[:x:]`, `[=x=]` and `[.x.]` right after the opening
+    // bracket as if the opening bracket started them
+    if (j < pattern.len && memchr(":=.", pattern.ptr[j], 3) &&
+        find_bracket_close(pattern, j + 1, pattern.ptr[j]) < pattern.len)
+    {
+        result = BRACKET_UNSUPPORTED;
+        goto done;
+    }
+
+    for (bool first = true;; first = false)
+    {
+        if (j >= pattern.len)
+        {
+            result = BRACKET_UNTERMINATED;
+            goto done;
+        }
+
+        if (pattern.ptr[j] == ']' && !first)
+        {
+            ++j;
+            break;
+        }
+
+        if (is_bracket_special(pattern, j) && pattern.ptr[j + 1] == ':' &&
+            find_bracket_close(pattern, j + 2, ':') < pattern.len)
+        {
+            size_t const end = find_bracket_close(pattern, j + 2, ':');
+
+            struct sv const name = {
+                .ptr = &pattern.ptr[j + 2],
+                .len = end - (j + 2),
+            };
+
+            struct char_class const *class = NULL;
+            for (size_t k = 0; k < ARRAY_LENGTH(char_classes); ++k)
+            {
+                if (sv_equal_cstr(name, char_classes[k].name))
+                {
+                    class = &char_classes[k];
+                    break;
+                }
+            }
+
+            if (!class)
+            {
+                result = BRACKET_UNSUPPORTED;
+                goto done;
+            }
+
+            for (unsigned c = 0; c <= UINT8_MAX; ++c)
+            {
+                if (class->is((int)c))
+                {
+                    byteset_add(set, (unsigned char)c);
+                }
+            }
+
+            j = end + 2;
+            continue;
+        }
+
+        unsigned char lo;
+        bool const is_equiv =
+            is_bracket_special(pattern, j) && pattern.ptr[j + 1] == '=';
+        bool const is_collating =
+            is_bracket_special(pattern, j) && pattern.ptr[j + 1] == '.';
+
+        result = parse_bracket_char(pattern, &j, false, &lo);
+        if (result)
+        {
+            goto done;
+        }
+
+        if (j + 1 == pattern.len && pattern.ptr[j] == '-')
+        {
+            // glibc fails the whole match on a range with no end
+            result = BRACKET_UNSUPPORTED;
+            goto done;
+        }
+
+        if (is_collating && j + 1 < pattern.len && pattern.ptr[j] == '-' &&
+            pattern.ptr[j + 1] == ']')
+        {
+            // glibc drops a collating symbol followed by a literal '-'
+            result = BRACKET_UNSUPPORTED;
+            goto done;
+        }
+
+        if (j + 1 < pattern.len && pattern.ptr[j] == '-' &&
+            pattern.ptr[j + 1] != ']')
+        {
+            if (is_equiv)
+            {
+                // Equivalence class as a range start
+                result = BRACKET_UNSUPPORTED;
+                goto done;
+            }
+
+            ++j;
+
+            unsigned char hi;
+            result = parse_bracket_char(pattern, &j, true, &hi);
+            if (result)
+            {
+                goto done;
+            }
+
+            if (lo <= hi)
+            {
+                byteset_add_range(set, lo, hi);
+            }
+        }
+        else
+        {
+            byteset_add(set, lo);
+        }
+    }
+
+    if (negate)
+    {
+        byteset_invert(set);
+    }
+
+    *i = j;
+
+done:
+    return result;
+}
+
+bool glob_compile(
+    struct sv const pattern,
+    struct glob_atom *const atoms,
+    size_t *const atom_count
+)
+{
+    bool ok = true;
+    size_t n = 0;
+
+    for (size_t i = 0; i < pattern.len;)
+    {
+        struct glob_atom atom = {0};
+        char const c = pattern.ptr[i];
+
+        if (c == '*')
+        {
+            atom.star = true;
+            ++i;
+
+            // Consecutive stars are equivalent to one
+            if (n > 0 && atoms[n - 1].star)
+            {
+                continue;
+            }
+        }
+        else if (c == '?')
+        {
+            byteset_invert(&atom.set);
+            ++i;
+        }
+        else if (c == '\\')
+        {
+            // A trailing backslash never matches (empty set)
+            if (i + 1 < pattern.len)
+            {
+                byteset_add(&atom.set, (unsigned char)pattern.ptr[i + 1]);
+            }
+            i += 2;
+        }
+        else if (c == '[')
+        {
+            switch (parse_bracket(pattern, &i, &atom.set))
+            {
+            case BRACKET_OK:
+                break;
+            case BRACKET_UNTERMINATED:
+                atom.set = (struct glob_byteset){0};
+                byteset_add(&atom.set, '[');
+                ++i;
+                break;
+            case BRACKET_UNSUPPORTED:
+                ok = false;
+                goto done;
+            }
+        }
+        else
+        {
+            byteset_add(&atom.set, (unsigned char)c);
+            ++i;
+        }
+
+        atoms[n++] = atom;
+    }
+
+done:
+    *atom_count = n;
+    return ok;
+}
+
+bool glob_match(
+    struct glob_atom const *const atoms,
+    size_t const atom_count,
+    struct sv const name
+)
+{
+    size_t a = 0;
+    size_t n = 0;
+
+    // Atom after the last star seen, and the name position where the star's
+    // run ends. Only the last star ever needs to take more bytes: anything
+    // an earlier star could absorb, the last one can too. So each pair of
+    // positions is tried at most once.
+    size_t star_next = SIZE_MAX;
+    size_t star_end = 0;
+
+    while (n < name.len)
+    {
+        if (a < atom_count && atoms[a].star)
+        {
+            star_next = ++a;
+            star_end = n;
+        }
+        else if (a < atom_count &&
+                 glob_byteset_has(&atoms[a].set, (unsigned char)name.ptr[n]))
+        {
+            ++a;
+            ++n;
+        }
+        else if (star_next != SIZE_MAX)
+        {
+            a = star_next;
+            n = ++star_end;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (a < atom_count && atoms[a].star)
+    {
+        ++a;
+    }
+
+    return a == atom_count;
+}
@@ -0,0 +1,50 @@
+#ifndef KRS_GLOB_H_
+#define KRS_GLOB_H_
+
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Set of byte values
+struct glob_byteset
+{
+    u64 bits[4];
+};
+
+nodiscard static inline bool glob_byteset_has( //
+    struct glob_byteset const *const set,
+    unsigned char const c
+)
+{
+    return (set->bits[c >> 6] >> (c & 63)) & 1;
+}
+
+// Element of a compiled glob pattern
+struct glob_atom
+{
+    // If true, matches any run of bytes. Otherwise matches one byte in `set`.
+    bool star;
+    struct glob_byteset set;
+};
+
+// Compile `pattern` into `atoms`, with the semantics of
+// `fnmatch(pattern, name, 0)` in the C locale. `atoms` must have room for
+// `pattern.len` elements. Returns false if the pattern uses an unsupported
+// bracket expression (unknown class or multi-character collating element).
+nodiscard bool glob_compile(
+    struct sv pattern,
+    struct glob_atom *atoms,
+    size_t *atom_count
+);
+
+// Check if `name` matches the compiled pattern `atoms`. Runs in
+// O(atom_count * name.len) time whatever the pattern.
+nodiscard bool glob_match(
+    struct glob_atom const *atoms,
+    size_t atom_count,
+    struct sv name
+);
+
+#endif
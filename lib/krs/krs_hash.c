@@ -0,0 +1,178 @@
+#include "krs_hash.h"
+
+#include <string.h>
+
+#define FNV1A_PRIME ((u64)0x100000001b3ULL)
+
+u64 hash_fnv1a(u64 hash, void const *const data, size_t const len)
+{
+    unsigned char const *const bytes = data;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+
+    return hash;
+}
+
+static u32 const sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static u32 sha256_rotr(u32 const x, unsigned const n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_compress(u32 state[8], unsigned char const block[64])
+{
+    u32 w[64];
+
+    for (size_t i = 0; i < 16; ++i)
+    {
+        w[i] = (u32)block[i * 4] << 24 | (u32)block[i * 4 + 1] << 16 |
+               (u32)block[i * 4 + 2] << 8 | (u32)block[i * 4 + 3];
+    }
+    for (size_t i = 16; i < 64; ++i)
+    {
+        u32 const s0 = sha256_rotr(w[i - 15], 7) ^
+                       sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        u32 const s1 = sha256_rotr(w[i - 2], 17) ^
+                       sha256_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    u32 a = state[0];
+    u32 b = state[1];
+    u32 c = state[2];
+    u32 d = state[3];
+    u32 e = state[4];
+    u32 f = state[5];
+    u32 g = state[6];
+    u32 h = state[7];
+
+    for (size_t i = 0; i < 64; ++i)
+    {
+        u32 const s1 =
+            sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25);
+        u32 const ch = (e & f) ^ (~e & g);
+        u32 const t1 = h + s1 + ch + sha256_k[i] + w[i];
+        u32 const s0 =
+            sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22);
+        u32 const maj = (a & b) ^ (a & c) ^ (b & c);
+        u32 const t2 = s0 + maj;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void hash_sha256_init(struct hash_sha256 *const h)
+{
+    *h = (struct hash_sha256){
+        .state = {
+            0x6a09e667,
+            0xbb67ae85,
+            0x3c6ef372,
+            0xa54ff53a,
+            0x510e527f,
+            0x9b05688c,
+            0x1f83d9ab,
+            0x5be0cd19,
+        },
+    };
+}
+
+void hash_sha256_update(
+    struct hash_sha256 *const h,
+    void const *const data,
+    size_t len
+)
+{
+    unsigned char const *bytes = data;
+    size_t used = (size_t)(h->len % 64);
+
+    h->len += len;
+
+    while (len > 0)
+    {
+        if (used == 0 && len >= 64)
+        {
+            sha256_compress(h->state, bytes);
+            bytes += 64;
+            len -= 64;
+            continue;
+        }
+
+        size_t const n = 64 - used < len ? 64 - used : len;
+        memcpy(&h->block[used], bytes, n);
+        used += n;
+        bytes += n;
+        len -= n;
+
+        if (used == 64)
+        {
+            sha256_compress(h->state, h->block);
+            used = 0;
+        }
+    }
+}
+
+void hash_sha256_final(
+    struct hash_sha256 *const h,
+    unsigned char digest[HASH_SHA256_SIZE]
+)
+{
+    u64 const bits = h->len * 8;
+    size_t used = (size_t)(h->len % 64);
+
+    h->block[used++] = 0x80;
+    if (used > 56)
+    {
+        memset(&h->block[used], 0, 64 - used);
+        sha256_compress(h->state, h->block);
+        used = 0;
+    }
+    memset(&h->block[used], 0, 56 - used);
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        h->block[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    }
+    sha256_compress(h->state, h->block);
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        digest[i * 4] = (unsigned char)(h->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(h->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(h->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)h->state[i];
+    }
+}
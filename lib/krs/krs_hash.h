@@ -0,0 +1,39 @@
+#ifndef KRS_HASH_H_
+#define KRS_HASH_H_
+
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include <stddef.h>
+
+// 64-bit FNV-1a offset basis
+#define HASH_FNV1A_INIT ((u64)0xcbf29ce484222325ULL)
+
+// Continue a 64-bit FNV-1a hash over `len` bytes
+nodiscard u64 hash_fnv1a(u64 hash, void const *data, size_t len);
+
+nodiscard static inline u64 hash_sv(struct sv const s)
+{
+    return hash_fnv1a(HASH_FNV1A_INIT, s.ptr, s.len);
+}
+
+// SHA-256, for when collisions must not happen in practice
+#define HASH_SHA256_SIZE 32
+
+struct hash_sha256
+{
+    u32 state[8];
+    // Bytes hashed so far
+    u64 len;
+    unsigned char block[64];
+};
+
+void hash_sha256_init(struct hash_sha256 *h);
+void hash_sha256_update(struct hash_sha256 *h, void const *data, size_t len);
+// Write the digest of everything hashed to `digest`
+void hash_sha256_final(
+    struct hash_sha256 *h,
+    unsigned char digest[HASH_SHA256_SIZE]
+);
+
+#endif
@@ -1,15 +1,39 @@
 #include "krs_log.h"
+#include "krs_types.h"
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #define LOG_ENV_VAR "LOG"
 
+// Messages longer than this are formatted on the heap
+#define LOG_LINE_SIZE 1024
+
 enum log_level log_level_printed = LL_WARN;
+enum log_level log_level_enabled = LL_WARN;
+
+#ifndef _WIN32
+static void log_async_update_enabled(void);
+#endif
 
 void log_set_level(enum log_level const ll)
-{ //
+{
     log_level_printed = ll;
+    log_level_enabled = ll;
+#ifndef _WIN32
+    log_async_update_enabled();
+#endif
 }
 
 char const *log_level_to_cstr(enum log_level const ll)
@@ -42,6 +66,472 @@ char const *log_level_to_cstr(enum log_level const ll)
     return s;
 }
 
+static void log_write_all(char const *buf, size_t len)
+{
+#ifdef _WIN32
+    fwrite(buf, 1, len, stderr);
+#else
+    while (len > 0)
+    {
+        ssize_t const n = write(STDERR_FILENO, buf, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+#endif
+}
+
+static void log_write_sync(
+    enum log_level const ll,
+    char const *const fmt,
+    va_list args
+)
+{
+    char line[LOG_LINE_SIZE];
+    char *buf = line;
+
+    int const prefix_len =
+        snprintf(line, sizeof(line), "%-5s ", log_level_to_cstr(ll));
+    size_t const msg_start = (size_t)prefix_len;
+
+    va_list retry;
+    va_copy(retry, args);
+
+    int const msg_len =
+        vsnprintf(&line[msg_start], sizeof(line) - msg_start, fmt, args);
+
+    if (msg_len < 0)
+    {
+        goto done;
+    }
+
+    // Room for the message, its newline and vsnprintf()'s NUL
+    size_t len = msg_start + (size_t)msg_len + 1;
+
+    if (len >= sizeof(line))
+    {
+        buf = malloc(len + 1);
+        if (buf)
+        {
+            memcpy(buf, line, msg_start);
+            vsnprintf(&buf[msg_start], len - msg_start, fmt, retry);
+        }
+        else
+        {
+            // Print what fit
+            buf = line;
+            len = sizeof(line) - 1;
+        }
+    }
+
+    buf[len - 1] = '\n';
+    log_write_all(buf, len);
+
+done:
+    va_end(retry);
+    if (buf != line)
+    {
+        free(buf);
+    }
+}
+
+#ifndef _WIN32
+
+// Records queued per thread
+#define LOG_RING_SIZE 256
+// Longer messages are cut short when logging is asynchronous
+#define LOG_RECORD_TEXT_SIZE 240
+// Records dumped on a fatal error
+#define LOG_HISTORY_SIZE 64
+// Least severe level recorded for the dump, even if not printed
+#define LOG_HISTORY_LEVEL LL_INFO
+#define LOG_FLUSH_INTERVAL_NS (20 * 1000000L)
+#define LOG_BATCH_SIZE (16 * 1024)
+
+struct log_record
+{
+    // Since `log_async_start()`
+    u64 time_ns;
+    enum log_level level;
+    unsigned thread;
+    size_t len;
+    char text[LOG_RECORD_TEXT_SIZE];
+};
+
+// Records of one thread. Only the thread moves `head`, and only the drain,
+// under `log_async.lock`, moves `tail`.
+struct log_ring
+{
+    struct log_ring *next;
+    unsigned thread;
+    atomic_size_t head;
+    atomic_size_t tail;
+    struct log_record records[LOG_RING_SIZE];
+};
+
+static struct
+{
+    atomic_bool running;
+    // Bumped by each start, so threads drop rings of an earlier run
+    atomic_uint generation;
+    atomic_uint thread_count;
+    // Records lost to full rings
+    atomic_size_t dropped;
+    _Atomic(struct log_ring *) rings;
+    u64 start_ns;
+    pthread_t flusher;
+
+    // Fields below are guarded by `lock`
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stopping;
+    struct log_record history[LOG_HISTORY_SIZE];
+    // Records ever added to `history`
+    size_t history_count;
+    char batch[LOG_BATCH_SIZE];
+    size_t batch_len;
+} log_async = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local struct log_ring *log_thread_ring;
+static _Thread_local unsigned log_thread_generation;
+
+static void log_async_update_enabled(void)
+{
+    if (atomic_load(&log_async.running))
+    {
+        log_level_enabled = MAX(log_level_printed, LOG_HISTORY_LEVEL);
+    }
+}
+
+static u64 log_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000u + (u64)ts.tv_nsec;
+}
+
+// Get the calling thread's ring, or NULL if out of memory
+static struct log_ring *log_thread_ring_get(void)
+{
+    unsigned const generation = atomic_load(&log_async.generation);
+
+    if (!log_thread_ring || log_thread_generation != generation)
+    {
+        struct log_ring *const ring = malloc(sizeof(*ring));
+        if (ring)
+        {
+            ring->thread = atomic_fetch_add(&log_async.thread_count, 1);
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+
+            ring->next = atomic_load(&log_async.rings);
+            while (!atomic_compare_exchange_weak(
+                &log_async.rings,
+                &ring->next,
+                ring
+            ))
+            {
+            }
+        }
+
+        log_thread_ring = ring;
+        log_thread_generation = generation;
+    }
+
+    return log_thread_ring;
+}
+
+// Queue a message without waiting. Returns false if it must be printed
+// synchronously instead.
+static bool log_async_push(
+    enum log_level const ll,
+    char const *const fmt,
+    va_list args
+)
+{
+    struct log_ring *const ring = log_thread_ring_get();
+    if (!ring)
+    {
+        return false;
+    }
+
+    size_t const head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t const tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= LOG_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&log_async.dropped, 1, memory_order_relaxed);
+    }
+    else
+    {
+        struct log_record *const record = &ring->records[head % LOG_RING_SIZE];
+
+        record->time_ns = log_now_ns() - log_async.start_ns;
+        record->level = ll;
+        record->thread = ring->thread;
+
+        size_t const cap = sizeof(record->text);
+        int const len = vsnprintf(record->text, cap, fmt, args);
+        record->len = len < 0 ? 0 : MIN((size_t)len, cap - 1);
+
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    }
+
+    return true;
+}
+
+static void log_batch_flush(void)
+{
+    log_write_all(log_async.batch, log_async.batch_len);
+    log_async.batch_len = 0;
+}
+
+printf_format(1, 2) static void log_batch_printf(char const *const fmt, ...)
+{
+    size_t avail = sizeof(log_async.batch) - log_async.batch_len;
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        va_list args;
+        va_start(args, fmt);
+        int const len = vsnprintf(
+            &log_async.batch[log_async.batch_len],
+            avail,
+            fmt,
+            args
+        );
+        va_end(args);
+
+        if (len >= 0 && (size_t)len < avail)
+        {
+            log_async.batch_len += (size_t)len;
+            break;
+        }
+
+        // Lines are shorter than the batch, so they fit once it is empty
+        log_batch_flush();
+        avail = sizeof(log_async.batch);
+    }
+}
+
+static void log_batch_record(struct log_record const *const record)
+{
+    log_batch_printf(
+        "%llu.%06llu [%u] %-5s %.*s\n",
+        (unsigned long long)(record->time_ns / 1000000000u),
+        (unsigned long long)(record->time_ns / 1000u % 1000000u),
+        record->thread,
+        log_level_to_cstr(record->level),
+        (int)record->len,
+        record->text
+    );
+}
+
+// Print and record every queued message, oldest first. Caller holds
+// `log_async.lock`.
+static void log_async_drain(void)
+{
+    for (;;)
+    {
+        struct log_ring *oldest = NULL;
+        struct log_record const *record = NULL;
+
+        for (struct log_ring *ring = atomic_load(&log_async.rings); ring;
+             ring = ring->next)
+        {
+            size_t const tail =
+                atomic_load_explicit(&ring->tail, memory_order_relaxed);
+            size_t const head =
+                atomic_load_explicit(&ring->head, memory_order_acquire);
+
+            struct log_record const *const r =
+                &ring->records[tail % LOG_RING_SIZE];
+            if (tail != head && (!record || r->time_ns < record->time_ns))
+            {
+                oldest = ring;
+                record = r;
+            }
+        }
+
+        if (!oldest)
+        {
+            break;
+        }
+
+        if (record->level <= log_level_printed)
+        {
+            log_batch_record(record);
+        }
+        log_async.history[log_async.history_count++ % LOG_HISTORY_SIZE] =
+            *record;
+
+        atomic_fetch_add_explicit(&oldest->tail, 1, memory_order_release);
+    }
+
+    size_t const dropped = atomic_exchange(&log_async.dropped, 0);
+    if (dropped > 0)
+    {
+        log_batch_printf(
+            "%-5s %lu log messages dropped\n",
+            log_level_to_cstr(LL_WARN),
+            (unsigned long)dropped
+        );
+    }
+
+    log_batch_flush();
+}
+
+static void *log_async_flusher(void *const arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&log_async.lock);
+
+    while (!log_async.stopping)
+    {
+        log_async_drain();
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_nsec -= 1000000000L;
+            ++deadline.tv_sec;
+        }
+
+        pthread_cond_timedwait(&log_async.cond, &log_async.lock, &deadline);
+    }
+
+    log_async_drain();
+
+    pthread_mutex_unlock(&log_async.lock);
+    return NULL;
+}
+
+// Print queued messages, then the most recent ones including unprinted ones
+static void log_async_dump(void)
+{
+    pthread_mutex_lock(&log_async.lock);
+
+    log_async_drain();
+
+    size_t const count =
+        MIN(log_async.history_count, (size_t)LOG_HISTORY_SIZE);
+    log_batch_printf(
+        "----- Last %lu log messages -----\n",
+        (unsigned long)count
+    );
+    for (size_t i = log_async.history_count - count;
+         i < log_async.history_count;
+         ++i)
+    {
+        log_batch_record(&log_async.history[i % LOG_HISTORY_SIZE]);
+    }
+    log_batch_printf("-----\n");
+    log_batch_flush();
+
+    pthread_mutex_unlock(&log_async.lock);
+}
+
+bool log_async_start(void)
+{
+    bool ok = true;
+
+    if (atomic_load(&log_async.running))
+    {
+        goto done;
+    }
+
+    log_async.stopping = false;
+    log_async.history_count = 0;
+    log_async.start_ns = log_now_ns();
+    atomic_fetch_add(&log_async.generation, 1);
+
+    if (pthread_create(&log_async.flusher, NULL, log_async_flusher, NULL))
+    {
+        ok = false;
+        goto done;
+    }
+
+    atomic_store(&log_async.running, true);
+    log_async_update_enabled();
+
+done:
+    return ok;
+}
+
+void log_async_stop(void)
+{
+    if (atomic_load(&log_async.running))
+    {
+        atomic_store(&log_async.running, false);
+        log_level_enabled = log_level_printed;
+
+        pthread_mutex_lock(&log_async.lock);
+        log_async.stopping = true;
+        pthread_cond_signal(&log_async.cond);
+        pthread_mutex_unlock(&log_async.lock);
+
+        pthread_join(log_async.flusher, NULL);
+
+        struct log_ring *ring = atomic_exchange(&log_async.rings, NULL);
+        while (ring)
+        {
+            struct log_ring *const next = ring->next;
+            free(ring);
+            ring = next;
+        }
+    }
+}
+
+#else
+
+bool log_async_start(void)
+{
+    return false;
+}
+
+void log_async_stop(void)
+{
+}
+
+#endif
+
+void log_write(enum log_level const ll, char const *const fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    bool queued = false;
+
+#ifndef _WIN32
+    queued = atomic_load_explicit(&log_async.running, memory_order_acquire) &&
+             log_async_push(ll, fmt, args);
+    if (queued && ll == LL_FATAL)
+    {
+        log_async_dump();
+    }
+#endif
+
+    if (!queued && ll <= log_level_printed)
+    {
+        log_write_sync(ll, fmt, args);
+    }
+
+    va_end(args);
+}
+
 void log_setup_from_env(void)
 {
     char const *log_env = getenv(LOG_ENV_VAR);
@@ -50,23 +540,23 @@ void log_setup_from_env(void)
     {
         if (strcmp(log_env, "critical") == 0)
         {
-            log_level_printed = LL_FATAL;
+            log_set_level(LL_FATAL);
         }
         else if (strcmp(log_env, "error") == 0)
         {
-            log_level_printed = LL_ERROR;
+            log_set_level(LL_ERROR);
         }
         else if (strcmp(log_env, "warn") == 0)
         {
-            log_level_printed = LL_WARN;
+            log_set_level(LL_WARN);
         }
         else if (strcmp(log_env, "info") == 0)
         {
-            log_level_printed = LL_INFO;
+            log_set_level(LL_INFO);
         }
         else if (strcmp(log_env, "debug") == 0)
         {
-            log_level_printed = LL_DEBUG;
+            log_set_level(LL_DEBUG);
         }
         else
         {
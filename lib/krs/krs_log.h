@@ -2,6 +2,7 @@
 #define KRS_LOG_H_
 
 #include "krs_cc_ext.h"
+#include <stdbool.h>
 #include <stdio.h>
 
 enum log_level
@@ -14,22 +15,42 @@ enum log_level
     LL_DEBUG
 };
 
+// Least severe level compiled in. Less severe messages are removed along
+// with their arguments, e.g. `-DKRS_LOG_MIN_LEVEL=LL_INFO` drops debug logs.
+#ifndef KRS_LOG_MIN_LEVEL
+#define KRS_LOG_MIN_LEVEL LL_DEBUG
+#endif
+
+// Arguments are only evaluated if the message is printed or recorded
 #define klog(level, ...)                                                       \
     do                                                                         \
     {                                                                          \
-        if (level <= log_level_printed)                                        \
+        if ((level) <= KRS_LOG_MIN_LEVEL && (level) <= log_level_enabled)      \
         {                                                                      \
-            fprintf(stderr, "%-5s ", log_level_to_cstr(level));                \
-            fprintf(stderr, __VA_ARGS__);                                      \
-            fprintf(stderr, "\n");                                             \
+            log_write(level, __VA_ARGS__);                                     \
         }                                                                      \
     } while (0)
 
 nodiscard char const *log_level_to_cstr(enum log_level const ll);
+
+// Print a message to stderr as one line, in a single write, or queue it if
+// logging is asynchronous
+printf_format(2, 3) void log_write(enum log_level ll, char const *fmt, ...);
 void log_setup_from_env(void);
 
 void log_set_level(enum log_level const ll);
 
+// Queue messages in a ring buffer per thread, printed in batches by a
+// background thread, so logging never waits on stderr. Recent messages,
+// including info messages that are not printed, are dumped on a fatal
+// error. Returns false if logging stays synchronous.
+nodiscard bool log_async_start(void);
+// Print queued messages and stop the background thread. No other thread
+// may be logging.
+void log_async_stop(void);
+
 extern enum log_level log_level_printed;
+// Least severe level printed or recorded
+extern enum log_level log_level_enabled;
 
 #endif
@@ -1,12 +1,20 @@
 #include "krs_str.h"
+#include "krs_arena.h"
 #include "krs_dynamic_array.h"
+#include "krs_types.h"
 
-#include <ctype.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 struct str str_from_cstr(char *const cstr)
 {
     assert(cstr);
@@ -26,59 +34,167 @@ struct sv sv_from_cstr(char const *const cstr)
     };
 }
 
+bool sv_equal(struct sv const a, struct sv const b)
+{
+    return (a.len == b.len) && (memcmp(a.ptr, b.ptr, a.len) == 0);
+}
+
 bool sv_equal_cstr(struct sv const s, char const *const cstr)
 {
     assert(cstr);
     return (s.len == strlen(cstr)) && (strncmp(s.ptr, cstr, s.len) == 0);
 }
 
-bool sv_split_at_delims(
-    struct sv const s,
-    char const *const delims,
-    struct sv *const head,
-    struct sv *const tail
-)
+//
+// charset
+//
+
+struct charset charset_from_cstr(char const *cstr)
+{
+    assert(cstr);
+
+    struct charset set = {0};
+
+    for (; *cstr; ++cstr)
+    {
+        charset_add(&set, *cstr);
+    }
+
+    return set;
+}
+
+void charset_add(struct charset *const set, char const c)
+{
+    if (!charset_contains(set, c))
+    {
+        unsigned char const b = (unsigned char)c;
+        set->bits[b >> 6] |= (uint64_t)1 << (b & 63);
+
+        if (set->member_count < CHARSET_VECTOR_MAX)
+        {
+            set->members[set->member_count] = b;
+        }
+        ++set->member_count;
+    }
+}
+
+size_t sv_find_charset(struct sv const s, struct charset const *const set)
 {
-    bool success = false;
+    unsigned char const *const p = (void const *)s.ptr;
+    size_t const n = set->member_count;
+    size_t i = 0;
 
-    for (size_t i = 0; i < s.len; ++i)
+    // Vector loops compare each block against every member, so they only
+    // pay off for small sets. Delimiter sets in practice have 1-4 members.
+    if (n > 0 && n <= CHARSET_VECTOR_MAX)
     {
-        if (strchr(delims, s.ptr[i]))
+#ifdef __AVX2__
+        __m256i needles256[CHARSET_VECTOR_MAX];
+        for (size_t k = 0; k < n; ++k)
+        {
+            needles256[k] = _mm256_set1_epi8((char)set->members[k]);
+        }
+
+        for (; i + 32 <= s.len; i += 32)
         {
-            if (head)
+            __m256i const v = _mm256_loadu_si256((void const *)&p[i]);
+            __m256i hits = _mm256_cmpeq_epi8(v, needles256[0]);
+            for (size_t k = 1; k < n; ++k)
             {
-                *head = (struct sv){
-                    .ptr = s.ptr,
-                    .len = i,
-                };
+                hits = _mm256_or_si256(
+                    hits,
+                    _mm256_cmpeq_epi8(v, needles256[k])
+                );
             }
-            if (tail)
+
+            unsigned const mask = (unsigned)_mm256_movemask_epi8(hits);
+            if (mask)
             {
-                *tail = (struct sv){
-                    .ptr = &s.ptr[i],
-                    .len = s.len - i,
-                };
+                i += (size_t)__builtin_ctz(mask);
+                goto done;
             }
+        }
+#endif
 
-            success = true;
+#ifdef __SSE2__
+        __m128i needles[CHARSET_VECTOR_MAX];
+        for (size_t k = 0; k < n; ++k)
+        {
+            needles[k] = _mm_set1_epi8((char)set->members[k]);
+        }
 
-            goto done;
+        for (; i + 16 <= s.len; i += 16)
+        {
+            __m128i const v = _mm_loadu_si128((void const *)&p[i]);
+            __m128i hits = _mm_cmpeq_epi8(v, needles[0]);
+            for (size_t k = 1; k < n; ++k)
+            {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, needles[k]));
+            }
+
+            unsigned const mask = (unsigned)_mm_movemask_epi8(hits);
+            if (mask)
+            {
+                i += (size_t)__builtin_ctz(mask);
+                goto done;
+            }
         }
+#endif
     }
 
+    while (i < s.len && !charset_contains(set, s.ptr[i]))
+    {
+        ++i;
+    }
+
+done:
+    return i;
+}
+
+bool sv_split_at_charset(
+    struct sv const s,
+    struct charset const *const set,
+    struct sv *const head,
+    struct sv *const tail
+)
+{
+    size_t const i = sv_find_charset(s, set);
+    bool const success = i < s.len;
+
     if (head)
     {
-        *head = s;
+        *head = (struct sv){
+            .ptr = s.ptr,
+            .len = i,
+        };
     }
     if (tail)
     {
-        *tail = sv_empty();
+        *tail = success ? (struct sv){
+                              .ptr = &s.ptr[i],
+                              .len = s.len - i,
+                          }
+                        : sv_empty();
     }
 
-done:
     return success;
 }
 
+bool sv_split_at_delims(
+    struct sv const s,
+    char const *const delims,
+    struct sv *const head,
+    struct sv *const tail
+)
+{
+    struct charset set = charset_from_cstr(delims);
+
+    // strchr() matches the terminator, so NUL bytes have always split
+    charset_add(&set, '\0');
+
+    return sv_split_at_charset(s, &set, head, tail);
+}
+
 bool sv_split_delims(
     struct sv const s,
     char const *const delims,
@@ -108,24 +224,116 @@ struct sv sv_trim_left_char(struct sv s, char const c)
     return s;
 }
 
+// Whitespace in the C locale: "\t\n\v\f\r" and space
+static inline bool is_ascii_space(char const c)
+{
+    unsigned char const b = (unsigned char)c;
+    return b == ' ' || (unsigned char)(b - '\t') <= '\r' - '\t';
+}
+
+#ifdef __AVX2__
+// Get a mask of the non-whitespace bytes of a 32-byte block
+static inline unsigned non_space_mask256(void const *const ptr)
+{
+    __m256i const v = _mm256_loadu_si256(ptr);
+    __m256i const ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i const space = _mm256_or_si256(
+        _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+        _mm256_cmpeq_epi8(
+            _mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')),
+            ctrl
+        )
+    );
+    return ~(unsigned)_mm256_movemask_epi8(space);
+}
+#endif
+
+#ifdef __SSE2__
+// Get a mask of the non-whitespace bytes of a 16-byte block
+static inline unsigned non_space_mask128(void const *const ptr)
+{
+    __m128i const v = _mm_loadu_si128(ptr);
+    __m128i const ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i const space = _mm_or_si128(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+        _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl)
+    );
+    return ~(unsigned)_mm_movemask_epi8(space) & 0xffff;
+}
+#endif
+
 struct sv sv_trim_left_whitespace(struct sv s)
 {
-    while (s.len > 0 && isspace(*s.ptr))
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 32 <= s.len; i += 32)
     {
-        ++s.ptr;
-        --s.len;
+        unsigned const mask = non_space_mask256(&s.ptr[i]);
+        if (mask)
+        {
+            i += (size_t)__builtin_ctz(mask);
+            goto done;
+        }
+    }
+#endif
+
+#ifdef __SSE2__
+    for (; i + 16 <= s.len; i += 16)
+    {
+        unsigned const mask = non_space_mask128(&s.ptr[i]);
+        if (mask)
+        {
+            i += (size_t)__builtin_ctz(mask);
+            goto done;
+        }
+    }
+#endif
+
+    while (i < s.len && is_ascii_space(s.ptr[i]))
+    {
+        ++i;
     }
 
+done:
+    s.ptr += i;
+    s.len -= i;
     return s;
 }
 
 struct sv sv_trim_right_whitespace(struct sv s)
 {
-    while (s.len > 0 && isspace(s.ptr[s.len - 1]))
+#ifdef __AVX2__
+    for (; s.len >= 32; s.len -= 32)
+    {
+        unsigned const mask = non_space_mask256(&s.ptr[s.len - 32]);
+        if (mask)
+        {
+            s.len -= (size_t)__builtin_clz(mask);
+            goto done;
+        }
+    }
+#endif
+
+#ifdef __SSE2__
+    for (; s.len >= 16; s.len -= 16)
+    {
+        unsigned const mask = non_space_mask128(&s.ptr[s.len - 16]);
+        if (mask)
+        {
+            // The mask has 16 bits, so 16 of its leading zeros are padding
+            s.len -= (size_t)__builtin_clz(mask) - 16;
+            goto done;
+        }
+    }
+#endif
+
+    while (s.len > 0 && is_ascii_space(s.ptr[s.len - 1]))
     {
         --s.len;
     }
 
+done:
     return s;
 }
 
@@ -166,12 +374,46 @@ void cstrbuf_debug_print(struct cstrbuf const b)
 
 void cstrbuf_deinit(struct cstrbuf *const b)
 {
-    if (b->ptr)
+    if (b->ptr && !b->arena)
     {
         free(b->ptr);
     }
 }
 
+// Make room for `n` more bytes after `b->len`
+static bool cstrbuf_grow(struct cstrbuf *const b, size_t const n)
+{
+    bool success = true;
+
+    if (!b->arena)
+    {
+        success = da_reserve(b, n);
+    }
+    else if (b->len + n > b->cap)
+    {
+        size_t const cap = MAX(MAX(b->cap * 2, b->len + n), 16);
+        char *const ptr = arena_realloc(b->arena, b->ptr, b->cap, cap);
+
+        success = ptr != NULL;
+        if (success)
+        {
+            b->ptr = ptr;
+            b->cap = cap;
+        }
+    }
+
+    return success;
+}
+
+void cstrbuf_clear(struct cstrbuf *const b)
+{
+    if (b->ptr)
+    {
+        b->len = 0;
+        b->ptr[0] = '\0';
+    }
+}
+
 struct str cstrbuf_to_str(struct cstrbuf const b)
 {
     return (struct str){
@@ -186,13 +428,12 @@ bool cstrbuf_extend_cstrn(
 {
     assert(cstr);
 
-    char *extension;
-
-    size_t const old_len = b->len;
-    bool const success = da_extend_uninit(b, n + 1, &extension);
+    bool const success = cstrbuf_grow(b, n + 1);
 
     if (success)
     {
+        char *extension = &b->ptr[b->len];
+
         size_t i = 0;
         for (; i < n && *cstr; ++i)
         {
@@ -200,7 +441,7 @@ bool cstrbuf_extend_cstrn(
         }
         *extension = '\0';
 
-        b->len = old_len + i;
+        b->len += i;
     }
 
     assert(b->ptr[b->len] == '\0');
@@ -221,7 +462,7 @@ bool cstrbuf_extend_sv(struct cstrbuf *const b, struct sv const s)
 
 bool cstrbuf_reserve(struct cstrbuf *const b, size_t const n)
 {
-    bool const success = da_reserve(b, n + 1);
+    bool const success = cstrbuf_grow(b, n + 1);
 
     if (success)
     {
@@ -53,6 +53,7 @@ static inline struct sv sv_from_str(struct str const str)
     };
 }
 
+nodiscard bool sv_equal(struct sv a, struct sv b);
 nodiscard bool sv_equal_cstr(struct sv s, char const *cstr);
 
 bool sv_split_at_delims(
@@ -66,6 +67,34 @@ nodiscard struct sv sv_trim_left_char(struct sv s, char c);
 nodiscard struct sv sv_trim_left_whitespace(struct sv s);
 nodiscard struct sv sv_trim_right_whitespace(struct sv s);
 nodiscard struct sv sv_trim_whitespace(struct sv s);
+
+// Most members a charset can have and still be searched with vector compares
+#define CHARSET_VECTOR_MAX 8
+
+// Set of bytes, built once and used to search for any of several delimiters
+struct charset
+{
+    uint64_t bits[4];
+    // First members added, for vector search if there are few enough
+    unsigned char members[CHARSET_VECTOR_MAX];
+    size_t member_count;
+};
+
+nodiscard struct charset charset_from_cstr(char const *cstr);
+void charset_add(struct charset *set, char c);
+nodiscard static inline bool charset_contains(
+    struct charset const *const set, char const c
+)
+{
+    unsigned char const b = (unsigned char)c;
+    return (set->bits[b >> 6] >> (b & 63)) & 1;
+}
+
+// Get the index of the first byte of `s` in `set`, or `s.len` if none is
+nodiscard size_t sv_find_charset(struct sv s, struct charset const *set);
+bool sv_split_at_charset(
+    struct sv s, struct charset const *set, struct sv *head, struct sv *tail
+);
 int sv_fprint_repr(FILE *stream, struct sv const *s);
 
 nodiscard struct str str_from_cstr(char *cstr);
@@ -113,6 +142,23 @@ static inline bool str_split_delims(
     }
     return split;
 }
+static inline bool str_split_at_charset(
+    struct str s, struct charset const *set, struct str *head, struct str *tail
+)
+{
+    struct sv h = sv_empty();
+    struct sv t = sv_empty();
+    bool split = sv_split_at_charset(sv_from_str(s), set, &h, &t);
+    if (head)
+    {
+        *head = str_from_sv_unsafe(h);
+    }
+    if (tail)
+    {
+        *tail = str_from_sv_unsafe(t);
+    }
+    return split;
+}
 static inline nodiscard struct str str_trim_left_char(struct str s, char c)
 {
     return str_from_sv_unsafe(sv_trim_left_char(sv_from_str(s), c));
@@ -137,15 +183,21 @@ char const *str_into_cstr_unsafe(struct str s, char *removed_char);
 // UNSAFE: Writes to `s.ptr[s.len]`
 void str_revert_into_cstr_unsafe(struct str s, char removed_char);
 
+struct arena;
+
 // Null-terminated ASCII string dynamic buffer
 struct cstrbuf
 {
     char *ptr;
     size_t len;
     size_t cap;
+    // Optional, allocates from this arena instead of the heap
+    struct arena *arena;
 };
 
 void cstrbuf_deinit(struct cstrbuf *b);
+// Set length to zero, keeping the allocation
+void cstrbuf_clear(struct cstrbuf *b);
 nodiscard struct str cstrbuf_to_str(struct cstrbuf b);
 nodiscard bool cstrbuf_extend_cstrn( //
     struct cstrbuf *b,
@@ -23,6 +23,25 @@ struct develop_vec
 #define develop_vec_PTRTYPE_ptr int
 #define VEC_IMPLEMENTATION
 // #define VEC_OPT_INFALLIBLE
+// #define VEC_OPT_INLINE
+#endif
+
+#ifndef vec_items
+// Elements of a vec instantiated with VEC_OPT_INLINE. They live in the
+// struct's `inline_buf` array until they outgrow it, then `ptr` is set.
+// Such vecs can be copied and moved while inline, so `ptr` cannot point
+// into the struct. `cap` stays 0 until the vec spills to the heap.
+#define vec_items(vec) ((vec)->ptr ? (vec)->ptr : (vec)->inline_buf)
+#endif
+
+#ifdef VEC_OPT_INLINE
+#define VEC_ITEMS_(vec) vec_items(vec)
+#define VEC_CAP_(vec)                                                          \
+    ((vec)->ptr ? (vec)->cap                                                   \
+                : sizeof((vec)->inline_buf) / sizeof((vec)->inline_buf[0]))
+#else
+#define VEC_ITEMS_(vec) ((vec)->ptr)
+#define VEC_CAP_(vec) ((vec)->cap)
 #endif
 
 #ifndef vec_realloc
@@ -78,23 +97,27 @@ alloc_fn prexy_methodname(Vec, reserve)( //
     size_t const n
 )
 {
-    assert(vec->ptr || (vec->len == 0 && vec->cap == 0));
+    assert(vec->ptr || vec->cap == 0);
+#ifndef VEC_OPT_INLINE
+    assert(vec->ptr || vec->len == 0);
+#endif
 
     bool success;
 
+    size_t const cap = VEC_CAP_(vec);
     size_t const target_len = vec->len + n;
 
-    if (target_len <= vec->cap)
+    if (target_len <= cap)
     {
         success = true;
     }
-    else if (vec->cap >= CAP_LIMIT)
+    else if (cap >= CAP_LIMIT)
     {
         success = false;
     }
     else
     {
-        size_t new_cap = vec->cap < MIN_CAP ? MIN_CAP : GROW_CAP(vec->cap);
+        size_t new_cap = cap < MIN_CAP ? MIN_CAP : GROW_CAP(cap);
         while (new_cap < target_len)
         {
             new_cap = GROW_CAP(new_cap);
@@ -105,6 +128,16 @@ alloc_fn prexy_methodname(Vec, reserve)( //
 
         if (new_ptr)
         {
+#ifdef VEC_OPT_INLINE
+            if (!vec->ptr)
+            {
+                memcpy(
+                    new_ptr,
+                    vec->inline_buf,
+                    vec->len * sizeof(vec->ptr[0])
+                );
+            }
+#endif
             success = true;
             vec->ptr = new_ptr;
             vec->cap = new_cap;
@@ -134,7 +167,7 @@ alloc_fn prexy_methodname(Vec, append)(
 #ifdef VEC_OPT_INFALLIBLE
 
     prexy_methodname(Vec, reserve)(vec, n);
-    memmove(&vec->ptr[vec->len], arr, n);
+    memmove(&VEC_ITEMS_(vec)[vec->len], arr, n * sizeof(vec->ptr[0]));
     vec->len += n;
 
 #else
@@ -143,7 +176,7 @@ alloc_fn prexy_methodname(Vec, append)(
 
     if (success)
     {
-        memmove(&vec->ptr[vec->len], arr, n);
+        memmove(&VEC_ITEMS_(vec)[vec->len], arr, n * sizeof(vec->ptr[0]));
         vec->len += n;
     }
 
@@ -171,7 +204,7 @@ nodiscard bool prexy_methodname(Vec, pop)(
 
     if (success)
     {
-        *out = vec->ptr[--vec->len];
+        *out = VEC_ITEMS_(vec)[--vec->len];
     }
 
     return success;
@@ -179,6 +212,12 @@ nodiscard bool prexy_methodname(Vec, pop)(
 
 #endif
 
+#undef alloc_fn
+#undef VEC_ITEMS_
+#undef VEC_CAP_
 #undef vec_free
 #undef vec_realloc
+#undef VEC_OPT_INFALLIBLE
+#undef VEC_OPT_INLINE
+#undef VEC_IMPLEMENTATION
 #undef Vec
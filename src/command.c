@@ -0,0 +1,412 @@
+#include "command.h"
+#include "command_prexy.h"
+#include "error.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define Vec command_segments
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#ifdef _WIN32
+// cmd.exe command line limit
+#define CMD_LEN_LIMIT 8191
+#else
+#include <unistd.h>
+
+// The job pool runs a command with shell syntax as a single `/bin/sh -c`
+// argument, which Linux limits to MAX_ARG_STRLEN (32 pages). Commands it
+// spawns directly with `posix_spawnp()` are held to the same limit.
+#define CMD_ARG_STRLEN_LIMIT (32 * 4096 - 1)
+#endif
+
+#ifdef _WIN32
+// cmd.exe expands '%' even in quotes
+#define COMMAND_PLAIN_PUNCT "_./,+-@:"
+#else
+#define COMMAND_PLAIN_PUNCT "_./,+-@:%"
+#endif
+
+// Check if `c` means nothing special to the shell anywhere in a word
+static bool command_char_is_plain(unsigned char const c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') ||
+           (c != '\0' && strchr(COMMAND_PLAIN_PUNCT, c));
+}
+
+// Check if an unquoted placeholder needs quotes around `filename`
+static bool command_needs_quotes(struct sv const filename)
+{
+    bool needs = filename.len == 0;
+
+    for (size_t i = 0; !needs && i < filename.len; ++i)
+    {
+        needs = !command_char_is_plain((unsigned char)filename.ptr[i]);
+    }
+
+    return needs;
+}
+
+#ifdef _WIN32
+// cmd.exe takes everything in double quotes literally but '%'
+#define COMMAND_QUOTE '"'
+#else
+// sh takes everything in single quotes literally
+#define COMMAND_QUOTE '\''
+#endif
+
+// Get what stands for `c` of a filename in quotes of `quoting`, or NULL if
+// it stands for itself. An unquoted placeholder puts its own COMMAND_QUOTE
+// quotes around any name that has such a character.
+static char const *command_escape(
+    unsigned char const c,
+    enum command_quoting const quoting
+)
+{
+    char const *escape = NULL;
+
+#ifdef _WIN32
+    (void)quoting;
+
+    switch (c)
+    {
+    case '"':
+        // Filenames cannot contain '"', but programs read '""' in quotes as
+        // one
+        escape = "\"\"";
+        break;
+    case '%':
+        // Outside the quotes, '^' stops it starting a variable
+        escape = "\"^%\"";
+        break;
+    default:
+        break;
+    }
+#else
+    if (quoting == COMMAND_DOUBLE_QUOTED)
+    {
+        switch (c)
+        {
+        case '"':
+            escape = "\\\"";
+            break;
+        case '\\':
+            escape = "\\\\";
+            break;
+        case '$':
+            escape = "\\$";
+            break;
+        case '`':
+            escape = "\\`";
+            break;
+        default:
+            break;
+        }
+    }
+    else if (c == '\'')
+    {
+        // A single quote ends the quoting, is escaped, and starts it again
+        escape = "'\\''";
+    }
+#endif
+
+    return escape;
+}
+
+size_t command_quoted_len(
+    struct sv const filename,
+    enum command_quoting const quoting
+)
+{
+    size_t len = filename.len;
+
+    if (quoting == COMMAND_UNQUOTED && !command_needs_quotes(filename))
+    {
+        goto done;
+    }
+    if (quoting == COMMAND_UNQUOTED)
+    {
+        len += 2;
+    }
+
+    for (size_t i = 0; i < filename.len; ++i)
+    {
+        char const *const escape =
+            command_escape((unsigned char)filename.ptr[i], quoting);
+        if (escape)
+        {
+            len += strlen(escape) - 1;
+        }
+    }
+
+done:
+    return len;
+}
+
+struct command_arg_len command_arg_len(struct sv const files)
+{
+    struct command_arg_len arg_len = {0};
+
+    for (size_t i = 0; i < files.len;)
+    {
+        struct sv const filename = sv_from_cstr(&files.ptr[i]);
+
+        for (size_t q = 0; q < COMMAND_QUOTING_COUNT; ++q)
+        {
+            // Separating space
+            if (i > 0)
+            {
+                ++arg_len.len[q];
+            }
+            arg_len.len[q] += command_quoted_len(filename, q);
+        }
+
+        i += filename.len + 1;
+    }
+
+    return arg_len;
+}
+
+// Write `files` quoted for `quoting` and joined to `out`, returning the end
+static char *command_write_arg(
+    char *out,
+    struct sv const files,
+    enum command_quoting const quoting
+)
+{
+    for (size_t i = 0; i < files.len;)
+    {
+        struct sv const filename = sv_from_cstr(&files.ptr[i]);
+
+        if (i > 0)
+        {
+            *out++ = ' ';
+        }
+        i += filename.len + 1;
+
+        bool const wrap =
+            quoting == COMMAND_UNQUOTED && command_needs_quotes(filename);
+
+        if (quoting == COMMAND_UNQUOTED && !wrap)
+        {
+            memcpy(out, filename.ptr, filename.len);
+            out += filename.len;
+            continue;
+        }
+
+        if (wrap)
+        {
+            *out++ = COMMAND_QUOTE;
+        }
+        for (size_t j = 0; j < filename.len; ++j)
+        {
+            char const *const escape =
+                command_escape((unsigned char)filename.ptr[j], quoting);
+            if (escape)
+            {
+                size_t const n = strlen(escape);
+                memcpy(out, escape, n);
+                out += n;
+            }
+            else
+            {
+                *out++ = filename.ptr[j];
+            }
+        }
+        if (wrap)
+        {
+            *out++ = COMMAND_QUOTE;
+        }
+    }
+
+    return out;
+}
+
+// Get the quoting in effect after `text`, starting with `quoting`
+static enum command_quoting command_scan_quoting(
+    struct str const text,
+    enum command_quoting quoting
+)
+{
+    for (size_t i = 0; i < text.len; ++i)
+    {
+        char const c = text.ptr[i];
+
+#ifdef _WIN32
+        if (c == '"')
+        {
+            quoting = quoting == COMMAND_UNQUOTED ? COMMAND_DOUBLE_QUOTED
+                                                  : COMMAND_UNQUOTED;
+        }
+#else
+        switch (quoting)
+        {
+        case COMMAND_UNQUOTED:
+            if (c == '\\')
+            {
+                ++i;
+            }
+            else if (c == '\'')
+            {
+                quoting = COMMAND_SINGLE_QUOTED;
+            }
+            else if (c == '"')
+            {
+                quoting = COMMAND_DOUBLE_QUOTED;
+            }
+            break;
+        case COMMAND_SINGLE_QUOTED:
+            if (c == '\'')
+            {
+                quoting = COMMAND_UNQUOTED;
+            }
+            break;
+        case COMMAND_DOUBLE_QUOTED:
+            if (c == '\\')
+            {
+                ++i;
+            }
+            else if (c == '"')
+            {
+                quoting = COMMAND_UNQUOTED;
+            }
+            break;
+        case COMMAND_QUOTING_COUNT:
+            assert(false);
+            break;
+        }
+#endif
+    }
+
+    return quoting;
+}
+
+size_t command_len_limit(void)
+{
+#ifdef _WIN32
+    return CMD_LEN_LIMIT;
+#else
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0)
+    {
+        // POSIX minimum
+        arg_max = 4096;
+    }
+
+    // Leave half for the environment
+    return MIN((size_t)arg_max / 2, (size_t)CMD_ARG_STRLEN_LIMIT);
+#endif
+}
+
+enum error command_compile(
+    struct command_segments *const segments,
+    struct str const template,
+    struct command_template *const compiled
+)
+{
+    enum error err = OK;
+
+    *compiled = (struct command_template){
+        .segment_index = segments->len,
+    };
+
+    struct str head = {0};
+    struct str tail = template;
+    enum command_quoting quoting = COMMAND_UNQUOTED;
+
+    bool is_split;
+
+    do
+    {
+        is_split = str_split_delims(tail, "%", &head, &tail);
+        quoting = command_scan_quoting(head, quoting);
+
+        struct command_segment const segment = {
+            .text = head,
+            .quoting = quoting,
+        };
+        if (!command_segments_push(segments, segment))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+
+        ++compiled->segment_count;
+        compiled->literal_len += head.len;
+        if (is_split)
+        {
+            ++compiled->placeholder_count[quoting];
+        }
+    } while (is_split);
+
+done:
+    return err;
+}
+
+enum error command_format( //
+    struct cstrbuf *const cmd,
+    struct command_segments const *const segments,
+    struct command_template const *const template,
+    struct sv const files
+)
+{
+    assert(template->segment_count > 0);
+    assert(
+        template->segment_index + template->segment_count <= segments->len
+    );
+    assert(files.len > 0 && files.ptr[files.len - 1] == '\0');
+
+    enum error err = OK;
+
+    struct command_arg_len const arg_len = command_arg_len(files);
+    size_t const len = command_template_len(template, &arg_len);
+
+    cstrbuf_clear(cmd);
+    if (!cstrbuf_reserve(cmd, len))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    struct command_segment const *const segment =
+        &segments->ptr[template->segment_index];
+    char *out = cmd->ptr;
+
+    memcpy(out, segment[0].text.ptr, segment[0].text.len);
+    out += segment[0].text.len;
+
+    // Later placeholders copy the first one with the same quoting
+    char const *arg[COMMAND_QUOTING_COUNT] = {0};
+
+    for (size_t i = 1; i < template->segment_count; ++i)
+    {
+        enum command_quoting const quoting = segment[i - 1].quoting;
+
+        if (arg[quoting])
+        {
+            memcpy(out, arg[quoting], arg_len.len[quoting]);
+            out += arg_len.len[quoting];
+        }
+        else
+        {
+            arg[quoting] = out;
+            out = command_write_arg(out, files, quoting);
+        }
+        memcpy(out, segment[i].text.ptr, segment[i].text.len);
+        out += segment[i].text.len;
+    }
+
+    assert(out == &cmd->ptr[len]);
+    *out = '\0';
+    cmd->len = len;
+
+done:
+    return err;
+}
@@ -0,0 +1,106 @@
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "prexy.h"
+#include <stddef.h>
+
+// Shell quoting that the template puts around a placeholder
+enum command_quoting
+{
+    COMMAND_UNQUOTED,
+    // Inside '...', never on Windows
+    COMMAND_SINGLE_QUOTED,
+    // Inside "..."
+    COMMAND_DOUBLE_QUOTED,
+    COMMAND_QUOTING_COUNT,
+};
+
+// Literal part of a command template, between its '%' placeholders
+struct command_segment
+{
+    struct str text;
+    // Quoting of the placeholder after `text`, if any
+    enum command_quoting quoting;
+};
+
+prexy struct command_segments
+{
+    struct command_segment *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Command template split at its placeholders. The filenames go between
+// each pair of consecutive segments.
+struct command_template
+{
+    // Range of a `struct command_segments`, never empty
+    size_t segment_index;
+    size_t segment_count;
+    // Total length of the segments
+    size_t literal_len;
+    // Number of placeholders with each quoting
+    size_t placeholder_count[COMMAND_QUOTING_COUNT];
+};
+
+// Length of filenames once quoted and joined, for each placeholder quoting
+struct command_arg_len
+{
+    size_t len[COMMAND_QUOTING_COUNT];
+};
+
+// Maximum length of a formatted command line
+nodiscard size_t command_len_limit(void);
+
+// Split `template` at each '%', appending its segments to `segments`, and
+// note whether the template already quotes each placeholder
+nodiscard enum error command_compile(
+    struct command_segments *segments,
+    struct str template,
+    struct command_template *compiled
+);
+
+// Length of `filename` once quoted for a placeholder with `quoting`.
+// Unquoted names of only unremarkable characters are left as they are.
+nodiscard size_t command_quoted_len(
+    struct sv filename,
+    enum command_quoting quoting
+);
+
+// Length of `files`, which are NUL-terminated filenames, once quoted and
+// joined by spaces
+nodiscard struct command_arg_len command_arg_len(struct sv files);
+
+// Length of a formatted command whose filenames take `arg_len` characters
+// once quoted and joined
+nodiscard static inline size_t command_template_len(
+    struct command_template const *const template,
+    struct command_arg_len const *const arg_len
+)
+{
+    size_t len = template->literal_len;
+
+    for (size_t q = 0; q < COMMAND_QUOTING_COUNT; ++q)
+    {
+        len += template->placeholder_count[q] * arg_len->len[q];
+    }
+
+    return len;
+}
+
+// Set `cmd` to `template` with each placeholder replaced by `files`, which
+// are NUL-terminated filenames, quoted and joined by spaces. An unquoted
+// placeholder gets its own quotes. In one the template already quotes, only
+// the characters special in those quotes are escaped. A name stays literal
+// whatever it contains.
+nodiscard enum error command_format( //
+    struct cstrbuf *cmd,
+    struct command_segments const *segments,
+    struct command_template const *template,
+    struct sv files
+);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef PREXY_CLIENT_COMMAND_H_
+#define PREXY_CLIENT_COMMAND_H_
+
+/* Generated by prexy from: command.h */
+
+#include "prexy.h"
+
+// prexy struct command_segments
+// {
+//     struct command_segment *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define command_segments_X(F)                                                  \
+    F(simple, struct command_segment *, ptr)                                   \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define command_segments_FIELDTYPE_ptr struct command_segment *
+#define command_segments_IS_MUT_PTR_ptr 1
+#define command_segments_IS_CONST_PTR_ptr 0
+#define command_segments_PTRTYPE_ptr struct command_segment
+#define command_segments_FIELDTYPE_len size_t
+#define command_segments_IS_MUT_PTR_len 0
+#define command_segments_IS_CONST_PTR_len 0
+#define command_segments_FIELDTYPE_cap size_t
+#define command_segments_IS_MUT_PTR_cap 0
+#define command_segments_IS_CONST_PTR_cap 0
+
+#endif
@@ -0,0 +1,636 @@
+#include "config.h"
+#include "command.h"
+#include "command_prexy.h"
+#include "config_cache.h"
+#include "config_prexy.h"
+#include "error.h"
+#include "glob_dfa.h"
+#include "glob_dfa_prexy.h"
+#include "krs_glob.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "parser.h"
+#include "prexy.h"
+#include "timings.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define Vec patterns
+#define VEC_IMPLEMENTATION
+#define VEC_OPT_INLINE
+#include "krs_vec.inc.h"
+
+#define Vec rules
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec globs
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec ext_index
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec glob_dfa_patterns
+#include "krs_vec.inc.h"
+
+#define Vec glob_atoms
+#include "krs_vec.inc.h"
+
+#define Vec command_segments
+#include "krs_vec.inc.h"
+
+#define GLOB_METACHARS "*?[\\"
+#define EXT_INDEX_MIN_SLOTS 8
+#define GLOB_DFA_MAX_STATES 4096
+#define CONFIG_CACHE_SUFFIX ".cache"
+
+static enum error cstrbuf_init_from_file( //
+    struct cstrbuf *const cstrbuf,
+    char const *const filepath
+)
+{
+    enum error err = OK;
+
+    FILE *file = fopen(filepath, "rb");
+    if (!file)
+    {
+        perror(filepath);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size_t const len = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *buf = malloc(len + 1);
+    if (!buf)
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    size_t bytes_read = fread(buf, 1, len, file);
+    assert(bytes_read == len);
+    buf[bytes_read] = '\0';
+
+    *cstrbuf = (struct cstrbuf){
+        .ptr = buf,
+        .len = len,
+        .cap = len,
+    };
+
+done:
+    if (file)
+    {
+        fclose(file);
+    }
+    return err;
+}
+
+// Compile the config token stream into a rule table
+static enum error rules_compile( //
+    struct rules *const rules,
+    struct str const text
+)
+{
+    enum error err = OK;
+
+    struct rule rule = {0};
+
+    struct fnmar_parser parser = {0};
+    fnmar_parser_start(&parser, text);
+
+    while (!parser.is_done)
+    {
+        fnmar_parser_next(&parser);
+
+        switch (parser.token.kind)
+        {
+        case TOK_PATTERN:
+            if (!patterns_push(&rule.patterns, parser.token.str))
+            {
+                err = out_of_memory();
+                goto done;
+            }
+            break;
+        case TOK_CMD:
+            rule.command = parser.token.str;
+            if (!rules_push(rules, rule))
+            {
+                err = out_of_memory();
+                goto done;
+            }
+            rule = (struct rule){0};
+            break;
+        case TOK_NONE:
+        case TOK_COMMENT:
+        case TOK_SEMI:
+        case TOK_COLON:
+        case TOK_EOF:
+            // do nothing
+            break;
+        }
+    }
+
+    if (parser.unexpected_token)
+    {
+        err = ERR_SYNTAX;
+    }
+
+done:
+    patterns_deinit(&rule.patterns);
+    return err;
+}
+
+// Get `ext` if `pattern` is `*.ext`, where `ext` is literal text with no '.'
+static bool pattern_get_ext(struct str const pattern, struct str *const ext)
+{
+    bool is_ext =
+        pattern.len >= 2 && pattern.ptr[0] == '*' && pattern.ptr[1] == '.';
+
+    for (size_t i = 2; is_ext && i < pattern.len; ++i)
+    {
+        char const c = pattern.ptr[i];
+        is_ext = c != '.' && c != '\0' && !strchr(GLOB_METACHARS, c);
+    }
+
+    if (is_ext)
+    {
+        *ext = (struct str){
+            .ptr = &pattern.ptr[2],
+            .len = pattern.len - 2,
+        };
+    }
+
+    return is_ext;
+}
+
+// Get the text after the last '.' of `filename`
+static bool filename_get_ext(struct sv const filename, struct sv *const ext)
+{
+    bool found = false;
+
+    for (size_t i = filename.len; i > 0; --i)
+    {
+        if (filename.ptr[i - 1] == '.')
+        {
+            *ext = (struct sv){
+                .ptr = &filename.ptr[i],
+                .len = filename.len - i,
+            };
+            found = true;
+            break;
+        }
+    }
+
+    return found;
+}
+
+// Get the slot for `ext`, which is unused if `ext` is not in the index.
+// Returns NULL if the index is empty.
+static struct ext_entry *ext_index_find( //
+    struct ext_index const *const index,
+    struct sv const ext
+)
+{
+    struct ext_entry *entry = NULL;
+
+    if (index->len > 0)
+    {
+        size_t const mask = index->len - 1;
+
+        for (size_t i = (size_t)hash_sv(ext) & mask;; i = (i + 1) & mask)
+        {
+            entry = &index->ptr[i];
+
+            if (!entry->ext.ptr || sv_equal(sv_from_str(entry->ext), ext))
+            {
+                break;
+            }
+        }
+    }
+
+    return entry;
+}
+
+// Sort patterns into the extension index and the general glob list
+static enum error config_index_patterns(struct config *const config)
+{
+    enum error err = OK;
+
+    size_t ext_count = 0;
+    for (size_t i = 0; i < config->rules.len; ++i)
+    {
+        struct patterns const patterns = config->rules.ptr[i].patterns;
+        for (size_t j = 0; j < patterns.len; ++j)
+        {
+            struct str ext;
+            ext_count += pattern_get_ext(vec_items(&patterns)[j], &ext) ? 1 : 0;
+        }
+    }
+
+    if (ext_count > 0)
+    {
+        // Keep load factor at or below 1/2
+        size_t slots = EXT_INDEX_MIN_SLOTS;
+        while (slots < ext_count * 2)
+        {
+            slots *= 2;
+        }
+
+        for (size_t i = 0; i < slots; ++i)
+        {
+            if (!ext_index_push(&config->ext_index, (struct ext_entry){0}))
+            {
+                err = out_of_memory();
+                goto done;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < config->rules.len; ++i)
+    {
+        struct patterns const patterns = config->rules.ptr[i].patterns;
+        for (size_t j = 0; j < patterns.len; ++j)
+        {
+            struct str ext;
+            if (pattern_get_ext(vec_items(&patterns)[j], &ext))
+            {
+                struct ext_entry *const entry =
+                    ext_index_find(&config->ext_index, sv_from_str(ext));
+
+                // Earlier rules take priority
+                if (!entry->ext.ptr)
+                {
+                    *entry = (struct ext_entry){
+                        .ext = ext,
+                        .rule = i,
+                    };
+                }
+            }
+            else
+            {
+                struct glob const glob = {
+                    .pattern = vec_items(&patterns)[j],
+                    .rule = i,
+                };
+
+                if (!globs_push(&config->globs, glob))
+                {
+                    err = out_of_memory();
+                    goto done;
+                }
+            }
+        }
+    }
+
+    klog(
+        LL_DEBUG,
+        "Indexed %lu extension patterns, %lu other patterns",
+        (unsigned long)ext_count,
+        (unsigned long)config->globs.len
+    );
+
+done:
+    return err;
+}
+
+static void glob_warn_unsupported(struct glob const *const glob)
+{
+    klog(
+        LL_WARN,
+        "Pattern '%.*s' is not supported and never matches",
+        str_format_args(glob->pattern)
+    );
+}
+
+// Compile each pattern of the general glob list into `config->glob_atoms`
+static enum error config_compile_globs(struct config *const config)
+{
+    enum error err = OK;
+
+    for (size_t i = 0; i < config->globs.len; ++i)
+    {
+        struct glob *const glob = &config->globs.ptr[i];
+        struct glob_atoms *const atoms = &config->glob_atoms;
+
+        if (!glob_atoms_reserve(atoms, glob->pattern.len))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+
+        glob->atom_index = atoms->len;
+        glob->unsupported = !glob_compile(
+            sv_from_str(glob->pattern),
+            &atoms->ptr[atoms->len],
+            &glob->atom_count
+        );
+
+        if (glob->unsupported)
+        {
+            glob_warn_unsupported(glob);
+            glob->atom_count = 0;
+        }
+
+        atoms->len += glob->atom_count;
+    }
+
+done:
+    return err;
+}
+
+// Split each rule's command at its placeholders
+static enum error config_compile_commands(struct config *const config)
+{
+    enum error err = OK;
+
+    for (size_t i = 0; !err && i < config->rules.len; ++i)
+    {
+        struct rule *const rule = &config->rules.ptr[i];
+        err = command_compile(
+            &config->command_segments,
+            rule->command,
+            &rule->template
+        );
+    }
+
+    return err;
+}
+
+// Combine the general glob list into one automaton, if possible
+static enum error config_build_dfa(struct config *const config)
+{
+    enum error err = OK;
+
+    struct glob_dfa_patterns patterns = {0};
+
+    for (size_t i = 0; i < config->globs.len; ++i)
+    {
+        struct glob const glob = config->globs.ptr[i];
+        if (glob.unsupported)
+        {
+            continue;
+        }
+
+        struct glob_dfa_pattern const pattern = {
+            .pattern = sv_from_str(glob.pattern),
+            .tag = (u32)glob.rule,
+        };
+
+        if (!glob_dfa_patterns_push(&patterns, pattern))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+    err = glob_dfa_build(&config->dfa, patterns, GLOB_DFA_MAX_STATES);
+
+done:
+    glob_dfa_patterns_deinit(&patterns);
+    return err;
+}
+
+// Parse and index `config->text`
+static enum error config_compile(struct config *const config)
+{
+    enum error err =
+        rules_compile(&config->rules, cstrbuf_to_str(config->text));
+    if (err)
+    {
+        goto done;
+    }
+
+    err = config_index_patterns(config);
+    if (!err)
+    {
+        err = config_compile_globs(config);
+    }
+    if (!err)
+    {
+        err = config_compile_commands(config);
+    }
+    if (!err)
+    {
+        err = config_build_dfa(config);
+    }
+
+done:
+    return err;
+}
+
+enum error config_init_from_file( //
+    struct config *const config,
+    char const *const config_filename,
+    struct config_opts const opts
+)
+{
+    assert(config_filename);
+
+    *config = (struct config){0};
+
+    struct cstrbuf cache_path = {0};
+
+    u64 const read_start = timings_start();
+    enum error err = cstrbuf_init_from_file(&config->text, config_filename);
+    timings_record(
+        TIMING_CONFIG_READ,
+        read_start,
+        sv_from_cstr(config_filename)
+    );
+    if (err)
+    {
+        goto done;
+    }
+
+    u64 const compile_start = timings_start();
+
+    struct config_source source = {0};
+
+    if (opts.cache)
+    {
+        err = config_source_init(
+            &source,
+            config_filename,
+            cstrbuf_to_str(config->text)
+        );
+        if (err)
+        {
+            goto done;
+        }
+
+        if (!cstrbuf_extend_cstr(&cache_path, config_filename) ||
+            !cstrbuf_extend_cstr(&cache_path, CONFIG_CACHE_SUFFIX))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+
+        // The cache holds the compiled globs and automaton, but not the
+        // commands
+        if (config_cache_load(config, cache_path.ptr, &source))
+        {
+            for (size_t i = 0; i < config->globs.len; ++i)
+            {
+                if (config->globs.ptr[i].unsupported)
+                {
+                    glob_warn_unsupported(&config->globs.ptr[i]);
+                }
+            }
+
+            err = config_compile_commands(config);
+            goto compiled;
+        }
+    }
+
+    err = config_compile(config);
+    if (err)
+    {
+        goto done;
+    }
+
+    // A missing cache only costs startup time
+    if (opts.cache && config_cache_save(config, cache_path.ptr, &source))
+    {
+        klog(LL_WARN, "Could not write config cache '%s'", cache_path.ptr);
+    }
+
+compiled:
+    timings_record(
+        TIMING_CONFIG_COMPILE,
+        compile_start,
+        sv_from_cstr(config_filename)
+    );
+
+done:
+    cstrbuf_deinit(&cache_path);
+    if (err)
+    {
+        config_deinit(config);
+    }
+    return err;
+}
+
+void config_deinit(struct config *const config)
+{
+    for (size_t i = 0; i < config->rules.len; ++i)
+    {
+        patterns_deinit(&config->rules.ptr[i].patterns);
+    }
+    rules_deinit(&config->rules);
+    ext_index_deinit(&config->ext_index);
+    globs_deinit(&config->globs);
+    if (!config->glob_atoms_borrowed)
+    {
+        glob_atoms_deinit(&config->glob_atoms);
+    }
+    command_segments_deinit(&config->command_segments);
+    glob_dfa_deinit(&config->dfa);
+    config_cache_unmap(config);
+    cstrbuf_deinit(&config->text);
+}
+
+// Get the rule index of the first glob matching `filename` whose rule is
+// before `match`, or `match` if none do
+static size_t config_scan_globs(
+    struct config const *const config,
+    struct sv const filename,
+    size_t match
+)
+{
+    for (size_t i = 0;
+         i < config->globs.len && config->globs.ptr[i].rule < match;
+         ++i)
+    {
+        struct glob const glob = config->globs.ptr[i];
+
+        bool const found_match =
+            !glob.unsupported &&
+            glob_match(
+                &config->glob_atoms.ptr[glob.atom_index],
+                glob.atom_count,
+                filename
+            );
+
+        klog(
+            LL_DEBUG,
+            found_match ? "'%.*s' matched pattern '%.*s'"
+                        : "'%.*s' did not match pattern '%.*s'",
+            str_format_args(filename),
+            str_format_args(glob.pattern)
+        );
+
+        if (found_match)
+        {
+            match = glob.rule;
+            break;
+        }
+    }
+
+    return match;
+}
+
+struct rule const *config_match( //
+    struct config const *const config,
+    struct sv const filename
+)
+{
+    assert(filename.ptr || filename.len == 0);
+
+    u64 const start = timings_start();
+
+    // Index of matched rule, or `rules.len` if none
+    size_t match = config->rules.len;
+
+    struct sv ext;
+    if (filename_get_ext(filename, &ext))
+    {
+        struct ext_entry const *const entry =
+            ext_index_find(&config->ext_index, ext);
+
+        if (entry && entry->ext.ptr)
+        {
+            klog(
+                LL_DEBUG,
+                "'%.*s' matched pattern '*.%.*s'",
+                str_format_args(filename),
+                str_format_args(entry->ext)
+            );
+            match = entry->rule;
+        }
+    }
+
+    // Only patterns of earlier rules can take priority
+    if (config->dfa.state_count > 0)
+    {
+        u32 const tag = glob_dfa_match(&config->dfa, filename);
+        if (tag != GLOB_DFA_NO_MATCH && tag < match)
+        {
+            klog(
+                LL_DEBUG,
+                "'%.*s' matched a pattern of rule %lu",
+                str_format_args(filename),
+                (unsigned long)tag
+            );
+            match = tag;
+        }
+    }
+    else
+    {
+        match = config_scan_globs(config, filename, match);
+    }
+
+    timings_record(TIMING_MATCH, start, filename);
+
+    return match < config->rules.len ? &config->rules.ptr[match] : NULL;
+}
@@ -0,0 +1,121 @@
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include "command.h"
+#include "error.h"
+#include "glob_dfa.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "prexy.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Inline vec (VEC_OPT_INLINE), since most rules have 1-3 patterns. Not
+// reflected by prexy, which does not take array fields.
+struct patterns
+{
+    struct str *ptr;
+    size_t len;
+    size_t cap;
+    struct str inline_buf[3];
+};
+#define patterns_PTRTYPE_ptr struct str
+
+struct rule
+{
+    // Glob patterns, any match selects the rule
+    struct patterns patterns;
+    // Command template, '%' is replaced with the filename
+    struct str command;
+    // Compiled `command`, in `config->command_segments`
+    struct command_template template;
+};
+
+prexy struct rules
+{
+    struct rule *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Pattern that needs the full glob matcher
+struct glob
+{
+    struct str pattern;
+    size_t rule;
+    // Range of `config->glob_atoms`
+    size_t atom_index;
+    size_t atom_count;
+    // Uses a bracket expression that `glob_compile()` rejects, never matches
+    bool unsupported;
+};
+
+prexy struct globs
+{
+    struct glob *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Slot of `struct ext_index`. Unused when `ext.ptr` is NULL.
+struct ext_entry
+{
+    // Text after the last '.' of a `*.ext` pattern
+    struct str ext;
+    // Lowest rule index with this extension
+    size_t rule;
+};
+
+// Open addressing hash table of `*.ext` patterns. `len` is a power of 2.
+prexy struct ext_index
+{
+    struct ext_entry *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Compiled config file. Strings point into `text`.
+// Immutable after `config_init_from_file()`.
+struct config
+{
+    struct cstrbuf text;
+    // Rules in file order (first match wins)
+    struct rules rules;
+    // Patterns of the form `*.ext`
+    struct ext_index ext_index;
+    // All other patterns in file order
+    struct globs globs;
+    // Compiled `globs`
+    struct glob_atoms glob_atoms;
+    // `glob_atoms` points into the cache file mapping
+    bool glob_atoms_borrowed;
+    // Segments of each rule's compiled command
+    struct command_segments command_segments;
+    // `globs` combined into one automaton, unless too large
+    struct glob_dfa dfa;
+    // Cache file mapping that `dfa` points into, if loaded from cache
+    void *cache_map;
+    size_t cache_map_len;
+};
+
+struct config_opts
+{
+    // Load from and save to a compiled cache next to the config file
+    bool cache;
+};
+
+nodiscard enum error config_init_from_file( //
+    struct config *config,
+    char const *config_filename,
+    struct config_opts opts
+);
+void config_deinit(struct config *config);
+
+// Get first rule with a pattern matching `filename`, or NULL if none match.
+// Never writes to `config`, so threads may share one.
+nodiscard struct rule const *config_match( //
+    struct config const *config,
+    struct sv filename
+);
+
+#endif
@@ -0,0 +1,684 @@
+#include "config_cache.h"
+#include "config.h"
+#include "config_prexy.h"
+#include "error.h"
+#include "file_stat.h"
+#include "glob_dfa.h"
+#include "krs_glob.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define Vec patterns
+#include "krs_vec.inc.h"
+
+#define Vec rules
+#include "krs_vec.inc.h"
+
+#define Vec globs
+#include "krs_vec.inc.h"
+
+#define Vec ext_index
+#include "krs_vec.inc.h"
+
+#ifndef _WIN32
+
+// Offset of an absent string (an unused extension index slot)
+#define CACHE_STR_NULL UINT32_MAX
+
+// File magic, the last byte is the format version
+static char const cache_magic[8] = {'F', 'N', 'M', 'A', 'R', 'C', '\0', 2};
+
+// The cache file is a header followed by sections of u32-aligned records:
+// rules, patterns, extension index slots, globs, compiled glob atoms,
+// automaton transitions and automaton accept tags. Section sizes follow from
+// the header counts, and the atoms section is padded to the alignment of
+// `struct glob_atom`. Strings are stored as ranges of the source text, so the
+// file has no pointers and the atoms and automaton can be used in place.
+struct cache_header
+{
+    char magic[8];
+    u64 source_size;
+    i64 source_mtime_sec;
+    i64 source_mtime_nsec;
+    u64 source_hash;
+    u32 rule_count;
+    u32 pattern_count;
+    u32 ext_slot_count;
+    u32 glob_count;
+    u32 atom_count;
+    // Zero if the config has no automaton
+    u32 dfa_state_count;
+    u32 dfa_class_count;
+    u8 dfa_byte_class[256];
+};
+
+// Range of the source text
+struct cache_str
+{
+    u32 offset;
+    u32 len;
+};
+
+struct cache_rule
+{
+    // Range of the patterns section
+    u32 pattern_index;
+    u32 pattern_count;
+    struct cache_str command;
+};
+
+struct cache_ext
+{
+    struct cache_str ext;
+    u32 rule;
+};
+
+struct cache_glob
+{
+    struct cache_str pattern;
+    u32 rule;
+    // Range of the atoms section, empty if unsupported
+    u32 atom_index;
+    u32 atom_count;
+    u32 unsupported;
+};
+
+// Byte offset of each section
+struct cache_layout
+{
+    size_t rules;
+    size_t patterns;
+    size_t ext;
+    size_t globs;
+    size_t atoms;
+    size_t trans;
+    size_t accept;
+    size_t size;
+};
+
+static bool cache_layout_init(
+    struct cache_layout *const layout,
+    struct cache_header const *const h
+)
+{
+    u64 offset = sizeof(*h);
+
+    layout->rules = (size_t)offset;
+    offset += (u64)h->rule_count * sizeof(struct cache_rule);
+    layout->patterns = (size_t)offset;
+    offset += (u64)h->pattern_count * sizeof(struct cache_str);
+    layout->ext = (size_t)offset;
+    offset += (u64)h->ext_slot_count * sizeof(struct cache_ext);
+    layout->globs = (size_t)offset;
+    offset += (u64)h->glob_count * sizeof(struct cache_glob);
+    offset = (offset + alignof(struct glob_atom) - 1) &
+             ~(u64)(alignof(struct glob_atom) - 1);
+    layout->atoms = (size_t)offset;
+    offset += (u64)h->atom_count * sizeof(struct glob_atom);
+    layout->trans = (size_t)offset;
+    offset += (u64)h->dfa_state_count * h->dfa_class_count * sizeof(u32);
+    layout->accept = (size_t)offset;
+    offset += (u64)h->dfa_state_count * sizeof(u32);
+    layout->size = (size_t)offset;
+
+    return offset <= SIZE_MAX;
+}
+
+static struct cache_str cache_str_from( //
+    struct str const text,
+    struct str const s
+)
+{
+    return (struct cache_str){
+        .offset = s.ptr ? (u32)(s.ptr - text.ptr) : CACHE_STR_NULL,
+        .len = (u32)s.len,
+    };
+}
+
+static bool cache_str_get(
+    struct str const text,
+    struct cache_str const s,
+    struct str *const out
+)
+{
+    bool const valid = s.offset <= text.len && s.len <= text.len - s.offset;
+
+    if (valid)
+    {
+        *out = (struct str){
+            .ptr = &text.ptr[s.offset],
+            .len = s.len,
+        };
+    }
+
+    return valid;
+}
+
+// Rebuild the in-memory tables of `config` from the mapped cache. The glob
+// atoms and automaton tables are used in place.
+static bool cache_restore(
+    struct config *const config,
+    char *const map,
+    struct cache_layout const *const layout
+)
+{
+    bool ok = false;
+
+    struct cache_header const *const h = (void *)map;
+    struct cache_rule const *const rules = (void *)&map[layout->rules];
+    struct cache_str const *const patterns = (void *)&map[layout->patterns];
+    struct cache_ext const *const ext = (void *)&map[layout->ext];
+    struct cache_glob const *const globs = (void *)&map[layout->globs];
+    struct glob_atom *const atoms = (void *)&map[layout->atoms];
+    struct str const text = cstrbuf_to_str(config->text);
+
+    for (u32 i = 0; i < h->rule_count; ++i)
+    {
+        struct cache_rule const r = rules[i];
+        struct rule rule = {0};
+
+        bool valid = r.pattern_index <= h->pattern_count &&
+                     r.pattern_count <= h->pattern_count - r.pattern_index &&
+                     cache_str_get(text, r.command, &rule.command);
+
+        for (u32 j = 0; valid && j < r.pattern_count; ++j)
+        {
+            struct str pattern;
+            valid = cache_str_get(text, patterns[r.pattern_index + j], &pattern)
+                 && patterns_push(&rule.patterns, pattern);
+        }
+
+        if (!valid || !rules_push(&config->rules, rule))
+        {
+            patterns_deinit(&rule.patterns);
+            goto done;
+        }
+    }
+
+    // Probing masks the hash with `len - 1` and stops at an unused slot, so
+    // a nonempty index must be a power of 2 with at least one unused slot
+    u32 const slots = h->ext_slot_count;
+    bool has_unused = slots == 0;
+
+    for (u32 i = 0; !has_unused && i < slots; ++i)
+    {
+        has_unused = ext[i].ext.offset == CACHE_STR_NULL;
+    }
+
+    if ((slots & (slots - 1)) != 0 || !has_unused)
+    {
+        goto done;
+    }
+
+    for (u32 i = 0; i < h->ext_slot_count; ++i)
+    {
+        struct ext_entry entry = {0};
+
+        if (ext[i].ext.offset != CACHE_STR_NULL &&
+            (!cache_str_get(text, ext[i].ext, &entry.ext) ||
+             ext[i].rule >= h->rule_count))
+        {
+            goto done;
+        }
+        entry.rule = ext[i].rule;
+
+        if (!ext_index_push(&config->ext_index, entry))
+        {
+            goto done;
+        }
+    }
+
+    for (u32 i = 0; i < h->glob_count; ++i)
+    {
+        struct cache_glob const g = globs[i];
+        struct glob glob = {
+            .rule = g.rule,
+            .atom_index = g.atom_index,
+            .atom_count = g.atom_count,
+            .unsupported = g.unsupported,
+        };
+
+        if (!cache_str_get(text, g.pattern, &glob.pattern) ||
+            glob.rule >= h->rule_count || g.unsupported > 1 ||
+            (g.unsupported && g.atom_count > 0) ||
+            g.atom_index > h->atom_count ||
+            g.atom_count > h->atom_count - g.atom_index ||
+            !globs_push(&config->globs, glob))
+        {
+            goto done;
+        }
+    }
+
+    // Any other value of a `bool` is undefined behavior
+    for (u32 i = 0; i < h->atom_count; ++i)
+    {
+        unsigned char star;
+        memcpy(&star, &atoms[i].star, sizeof(star));
+        if (star > 1)
+        {
+            goto done;
+        }
+    }
+
+    config->glob_atoms = (struct glob_atoms){
+        .ptr = atoms,
+        .len = h->atom_count,
+    };
+    config->glob_atoms_borrowed = true;
+
+    if (h->dfa_state_count > 0)
+    {
+        u32 *const trans = (void *)&map[layout->trans];
+        u32 *const accept = (void *)&map[layout->accept];
+        size_t const trans_len =
+            (size_t)h->dfa_state_count * h->dfa_class_count;
+
+        bool valid = h->dfa_state_count >= 2 && h->dfa_class_count > 0;
+
+        for (size_t c = 0; valid && c < ARRAY_LENGTH(h->dfa_byte_class); ++c)
+        {
+            valid = h->dfa_byte_class[c] < h->dfa_class_count;
+        }
+        for (size_t i = 0; valid && i < trans_len; ++i)
+        {
+            valid = trans[i] < h->dfa_state_count;
+        }
+
+        if (!valid)
+        {
+            goto done;
+        }
+
+        config->dfa = (struct glob_dfa){
+            .state_count = h->dfa_state_count,
+            .class_count = h->dfa_class_count,
+            .trans = trans,
+            .accept = accept,
+            .borrowed = true,
+        };
+        memcpy(
+            config->dfa.byte_class,
+            h->dfa_byte_class,
+            sizeof(config->dfa.byte_class)
+        );
+    }
+
+    ok = true;
+
+done:
+    return ok;
+}
+
+// Release tables restored by `cache_restore()`
+static void cache_restore_undo(struct config *const config)
+{
+    for (size_t i = 0; i < config->rules.len; ++i)
+    {
+        patterns_deinit(&config->rules.ptr[i].patterns);
+    }
+    rules_deinit(&config->rules);
+    ext_index_deinit(&config->ext_index);
+    globs_deinit(&config->globs);
+
+    config->rules = (struct rules){0};
+    config->ext_index = (struct ext_index){0};
+    config->globs = (struct globs){0};
+    config->glob_atoms = (struct glob_atoms){0};
+    config->glob_atoms_borrowed = false;
+    config->dfa = (struct glob_dfa){0};
+}
+
+enum error config_source_init(
+    struct config_source *const source,
+    char const *const config_filename,
+    struct str const text
+)
+{
+    enum error err = OK;
+
+    struct stat st;
+    if (stat(config_filename, &st))
+    {
+        perror(config_filename);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    struct timespec const mtime = file_stat_mtime(&st);
+    *source = (struct config_source){
+        .size = (u64)st.st_size,
+        .mtime_sec = (i64)mtime.tv_sec,
+        .mtime_nsec = (i64)mtime.tv_nsec,
+        .hash = hash_fnv1a(HASH_FNV1A_INIT, text.ptr, text.len),
+    };
+
+done:
+    return err;
+}
+
+bool config_cache_load(
+    struct config *const config,
+    char const *const path,
+    struct config_source const *const source
+)
+{
+    bool loaded = false;
+    char *map = NULL;
+    size_t map_len = 0;
+
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        klog(LL_DEBUG, "No config cache '%s'", path);
+        goto done;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || (u64)st.st_size < sizeof(struct cache_header) ||
+        (u64)st.st_size > SIZE_MAX)
+    {
+        klog(LL_DEBUG, "Invalid config cache '%s'", path);
+        goto done;
+    }
+    map_len = (size_t)st.st_size;
+
+    void *const p = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        klog(LL_DEBUG, "Could not map config cache '%s'", path);
+        goto done;
+    }
+    map = p;
+
+    struct cache_header const *const h = (void *)map;
+    if (memcmp(h->magic, cache_magic, sizeof(cache_magic)) ||
+        h->source_size != source->size ||
+        h->source_mtime_sec != source->mtime_sec ||
+        h->source_mtime_nsec != source->mtime_nsec ||
+        h->source_hash != source->hash)
+    {
+        klog(LL_DEBUG, "Config cache '%s' is stale", path);
+        goto done;
+    }
+
+    struct cache_layout layout;
+    if (!cache_layout_init(&layout, h) || layout.size != map_len ||
+        !cache_restore(config, map, &layout))
+    {
+        klog(LL_DEBUG, "Invalid config cache '%s'", path);
+        cache_restore_undo(config);
+        goto done;
+    }
+
+    klog(LL_DEBUG, "Loaded config cache '%s'", path);
+    loaded = true;
+
+    config->cache_map = map;
+    config->cache_map_len = map_len;
+
+done:
+    if (!loaded && map)
+    {
+        munmap(map, map_len);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    return loaded;
+}
+
+static bool cache_write(FILE *const file, void const *data, size_t const size)
+{
+    return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+// Write the header and every section of the cache to `file`
+static bool cache_write_all(
+    FILE *const file,
+    struct config const *const config,
+    struct config_source const *const source
+)
+{
+    struct str const text = cstrbuf_to_str(config->text);
+    struct glob_dfa const *const dfa = &config->dfa;
+
+    struct cache_header h = {
+        .source_size = source->size,
+        .source_mtime_sec = source->mtime_sec,
+        .source_mtime_nsec = source->mtime_nsec,
+        .source_hash = source->hash,
+        .rule_count = (u32)config->rules.len,
+        .ext_slot_count = (u32)config->ext_index.len,
+        .glob_count = (u32)config->globs.len,
+        .atom_count = (u32)config->glob_atoms.len,
+        .dfa_state_count = dfa->state_count,
+        .dfa_class_count = dfa->class_count,
+    };
+    memcpy(h.magic, cache_magic, sizeof(h.magic));
+    memcpy(h.dfa_byte_class, dfa->byte_class, sizeof(h.dfa_byte_class));
+
+    for (size_t i = 0; i < config->rules.len; ++i)
+    {
+        h.pattern_count += (u32)config->rules.ptr[i].patterns.len;
+    }
+
+    bool ok = cache_write(file, &h, sizeof(h));
+
+    u32 pattern_index = 0;
+    for (size_t i = 0; ok && i < config->rules.len; ++i)
+    {
+        struct rule const *const rule = &config->rules.ptr[i];
+        struct cache_rule const r = {
+            .pattern_index = pattern_index,
+            .pattern_count = (u32)rule->patterns.len,
+            .command = cache_str_from(text, rule->command),
+        };
+
+        ok = cache_write(file, &r, sizeof(r));
+        pattern_index += r.pattern_count;
+    }
+
+    for (size_t i = 0; ok && i < config->rules.len; ++i)
+    {
+        struct patterns const patterns = config->rules.ptr[i].patterns;
+
+        for (size_t j = 0; ok && j < patterns.len; ++j)
+        {
+            struct cache_str const s =
+                cache_str_from(text, vec_items(&patterns)[j]);
+            ok = cache_write(file, &s, sizeof(s));
+        }
+    }
+
+    for (size_t i = 0; ok && i < config->ext_index.len; ++i)
+    {
+        struct ext_entry const *const entry = &config->ext_index.ptr[i];
+        struct cache_ext const e = {
+            .ext = cache_str_from(text, entry->ext),
+            .rule = entry->ext.ptr ? (u32)entry->rule : 0,
+        };
+
+        ok = cache_write(file, &e, sizeof(e));
+    }
+
+    for (size_t i = 0; ok && i < config->globs.len; ++i)
+    {
+        struct glob const *const glob = &config->globs.ptr[i];
+        struct cache_glob const g = {
+            .pattern = cache_str_from(text, glob->pattern),
+            .rule = (u32)glob->rule,
+            .atom_index = (u32)glob->atom_index,
+            .atom_count = (u32)glob->atom_count,
+            .unsupported = glob->unsupported,
+        };
+
+        ok = cache_write(file, &g, sizeof(g));
+    }
+
+    struct cache_layout layout;
+    ok = ok && cache_layout_init(&layout, &h);
+
+    static char const zeros[alignof(struct glob_atom)] = {0};
+    size_t const globs_end =
+        layout.globs + config->globs.len * sizeof(struct cache_glob);
+    ok = ok && cache_write(file, zeros, layout.atoms - globs_end);
+
+    for (size_t i = 0; ok && i < config->glob_atoms.len; ++i)
+    {
+        // Copy field by field, so that no padding bytes reach the file
+        struct glob_atom a;
+        memset(&a, 0, sizeof(a));
+        a.star = config->glob_atoms.ptr[i].star;
+        a.set = config->glob_atoms.ptr[i].set;
+
+        ok = cache_write(file, &a, sizeof(a));
+    }
+
+    if (ok && dfa->state_count > 0)
+    {
+        ok = cache_write(
+                 file,
+                 dfa->trans,
+                 (size_t)dfa->state_count * dfa->class_count * sizeof(u32)
+             ) &&
+             cache_write(
+                 file,
+                 dfa->accept,
+                 (size_t)dfa->state_count * sizeof(u32)
+             );
+    }
+
+    return ok;
+}
+
+enum error config_cache_save(
+    struct config const *const config,
+    char const *const path,
+    struct config_source const *const source
+)
+{
+    enum error err = OK;
+    FILE *file = NULL;
+    struct cstrbuf tmp_path = {0};
+
+    // Offsets are stored as u32
+    if (config->text.len >= CACHE_STR_NULL)
+    {
+        klog(LL_DEBUG, "Config too large to cache");
+        goto done;
+    }
+
+    // Write to a private file, then rename it into place so that readers
+    // never see a partial cache
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+
+    if (!cstrbuf_extend_cstr(&tmp_path, path) ||
+        !cstrbuf_extend_cstr(&tmp_path, suffix))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    file = fopen(tmp_path.ptr, "wb");
+    if (!file)
+    {
+        perror(tmp_path.ptr);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    bool const written = cache_write_all(file, config, source);
+    int const close_result = fclose(file);
+
+    if (!written || close_result != 0 || rename(tmp_path.ptr, path) != 0)
+    {
+        perror(path);
+        remove(tmp_path.ptr);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    klog(LL_DEBUG, "Wrote config cache '%s'", path);
+
+done:
+    cstrbuf_deinit(&tmp_path);
+    return err;
+}
+
+void config_cache_unmap(struct config *const config)
+{
+    if (config->cache_map)
+    {
+        munmap(config->cache_map, config->cache_map_len);
+        config->cache_map = NULL;
+        config->cache_map_len = 0;
+    }
+}
+
+#else
+
+enum error config_source_init(
+    struct config_source *const source,
+    char const *const config_filename,
+    struct str const text
+)
+{
+    (void)config_filename;
+    (void)text;
+
+    *source = (struct config_source){0};
+    return OK;
+}
+
+bool config_cache_load(
+    struct config *const config,
+    char const *const path,
+    struct config_source const *const source
+)
+{
+    (void)config;
+    (void)path;
+    (void)source;
+
+    klog(LL_WARN, "Config cache is not supported on Windows");
+    return false;
+}
+
+enum error config_cache_save(
+    struct config const *const config,
+    char const *const path,
+    struct config_source const *const source
+)
+{
+    (void)config;
+    (void)path;
+    (void)source;
+
+    return OK;
+}
+
+void config_cache_unmap(struct config *const config)
+{
+    (void)config;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CONFIG_CACHE_H_
+#define CONFIG_CACHE_H_
+
+#include "config.h"
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include <stdbool.h>
+
+// Identity of a config file's contents. A cache is only used if it was
+// built from a source with the same identity.
+struct config_source
+{
+    u64 size;
+    i64 mtime_sec;
+    i64 mtime_nsec;
+    // FNV-1a hash of the text
+    u64 hash;
+};
+
+nodiscard enum error config_source_init(
+    struct config_source *source,
+    char const *config_filename,
+    struct str text
+);
+
+// Load the rule table, indexes, compiled globs and automaton of `config`
+// from the cache file at `path`. `config->text` must already hold the source
+// text. Returns false if the cache is missing, stale or invalid.
+nodiscard bool config_cache_load(
+    struct config *config,
+    char const *path,
+    struct config_source const *source
+);
+
+// Write the compiled form of `config` to the cache file at `path`
+nodiscard enum error config_cache_save(
+    struct config const *config,
+    char const *path,
+    struct config_source const *source
+);
+
+// Release the cache file mapping of `config`, if any
+void config_cache_unmap(struct config *config);
+
+#endif
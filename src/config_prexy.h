@@ -0,0 +1,74 @@
+#ifndef PREXY_CLIENT_CONFIG_H_
+#define PREXY_CLIENT_CONFIG_H_
+
+/* Generated by prexy from: config.h */
+
+#include "prexy.h"
+
+// prexy struct rules
+// {
+//     struct rule *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define rules_X(F)                                                             \
+    F(simple, struct rule *, ptr)                                              \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define rules_FIELDTYPE_ptr struct rule *
+#define rules_IS_MUT_PTR_ptr 1
+#define rules_IS_CONST_PTR_ptr 0
+#define rules_PTRTYPE_ptr struct rule
+#define rules_FIELDTYPE_len size_t
+#define rules_IS_MUT_PTR_len 0
+#define rules_IS_CONST_PTR_len 0
+#define rules_FIELDTYPE_cap size_t
+#define rules_IS_MUT_PTR_cap 0
+#define rules_IS_CONST_PTR_cap 0
+
+// prexy struct globs
+// {
+//     struct glob *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define globs_X(F)                                                             \
+    F(simple, struct glob *, ptr)                                              \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define globs_FIELDTYPE_ptr struct glob *
+#define globs_IS_MUT_PTR_ptr 1
+#define globs_IS_CONST_PTR_ptr 0
+#define globs_PTRTYPE_ptr struct glob
+#define globs_FIELDTYPE_len size_t
+#define globs_IS_MUT_PTR_len 0
+#define globs_IS_CONST_PTR_len 0
+#define globs_FIELDTYPE_cap size_t
+#define globs_IS_MUT_PTR_cap 0
+#define globs_IS_CONST_PTR_cap 0
+
+// prexy struct ext_index
+// {
+//     struct ext_entry *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define ext_index_X(F)                                                         \
+    F(simple, struct ext_entry *, ptr)                                         \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define ext_index_FIELDTYPE_ptr struct ext_entry *
+#define ext_index_IS_MUT_PTR_ptr 1
+#define ext_index_IS_CONST_PTR_ptr 0
+#define ext_index_PTRTYPE_ptr struct ext_entry
+#define ext_index_FIELDTYPE_len size_t
+#define ext_index_IS_MUT_PTR_len 0
+#define ext_index_IS_CONST_PTR_len 0
+#define ext_index_FIELDTYPE_cap size_t
+#define ext_index_IS_MUT_PTR_cap 0
+#define ext_index_IS_CONST_PTR_cap 0
+
+#endif
@@ -0,0 +1,576 @@
+#include "dispatch.h"
+#include "command.h"
+#include "config.h"
+#include "dispatch_prexy.h"
+#include "error.h"
+#include "krs_arena.h"
+#include "krs_dynamic_array.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "output_cache.h"
+#include "output_cache_prexy.h"
+#include "prexy.h"
+#include "stamp.h"
+#include "timings.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define Vec groups
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec pending_jobs
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec rule_usages
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec output_keys
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+static u64 rule_cmd_hash(struct rule const *const rule)
+{
+    return hash_sv(sv_from_str(rule->command));
+}
+
+static void pending_job_deinit(struct pending_job *const pending)
+{
+    cstrbuf_deinit(&pending->files);
+    output_keys_deinit(&pending->keys);
+}
+
+// Fill `d->next` for a command of `rule` on `files`, before it can change
+// them. `files` are NUL-terminated filenames. `key` is the already known
+// output key of a single file, or NULL.
+static enum error pending_job_prepare(
+    struct dispatch *const d,
+    struct rule const *const rule,
+    struct sv const files,
+    struct output_key const *const key
+)
+{
+    enum error err = OK;
+    struct pending_job *const next = &d->next;
+
+    cstrbuf_clear(&next->files);
+    next->keys.len = 0;
+    next->rule = (size_t)(rule - d->config->rules.ptr);
+    next->cmd_hash = rule_cmd_hash(rule);
+
+    if (!da_extend(&next->files, files.ptr, files.len))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    for (size_t i = 0; d->opts.output_cache && i < next->files.len;)
+    {
+        char const *const filename = &next->files.ptr[i];
+        i += strlen(filename) + 1;
+
+        struct output_key file_key;
+        if (key)
+        {
+            file_key = *key;
+        }
+        else
+        {
+            output_key_from_file(&file_key, filename, next->cmd_hash);
+        }
+
+        if (!output_keys_push(&next->keys, file_key))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+done:
+    return err;
+}
+
+// Record that `filename` is now in the state `cmd_hash`'s command leaves it
+static void dispatch_stamp(
+    struct dispatch const *const d,
+    char const *const filename,
+    u64 const cmd_hash
+)
+{
+    // A file the command removed has nothing to stamp
+    struct stamp stamp;
+    if (d->opts.stamps && stamp_from_file(&stamp, filename, cmd_hash) &&
+        stamp_db_put(d->opts.stamps, filename, &stamp))
+    {
+        klog(LL_WARN, "Could not record stamp for '%s'", filename);
+    }
+}
+
+// Hand the entry of the command about to start to its slot
+static void dispatch_job_start(void *const ctx, size_t const slot)
+{
+    struct dispatch *const d = ctx;
+
+    if (d->pending.len > 0)
+    {
+        // The slot's previous job is done, so its entry is empty
+        struct pending_job const empty = d->pending.ptr[slot];
+        d->pending.ptr[slot] = d->next;
+        d->next = empty;
+    }
+}
+
+static void dispatch_job_done(
+    void *const ctx,
+    size_t const slot,
+    char const *const cmd,
+    int const exitcode
+)
+{
+    struct dispatch *const d = ctx;
+
+    struct job const *const job = &d->pool.slots[slot];
+    timings_record(TIMING_COMMAND, job->start, sv_empty());
+
+    if (d->pending.len > 0)
+    {
+        struct pending_job *const pending = &d->pending.ptr[slot];
+        struct cstrbuf const files = pending->files;
+
+#ifdef _WIN32
+        long const pid = -1;
+#else
+        long const pid = (long)job->pid;
+#endif
+        trace_command(
+            slot,
+            job->start,
+            timings_now(),
+            pid,
+            pending->rule,
+            sv_from_str(cstrbuf_to_str(files)),
+            exitcode
+        );
+
+        if (d->usages.len > 0)
+        {
+            struct rule_usage *const usage = &d->usages.ptr[pending->rule];
+            struct job_usage *const total = &usage->total;
+
+            ++usage->count;
+            total->user_ns += job->usage.user_ns;
+            total->sys_ns += job->usage.sys_ns;
+            total->max_rss_kib =
+                MAX(total->max_rss_kib, job->usage.max_rss_kib);
+            total->voluntary_switches += job->usage.voluntary_switches;
+            total->involuntary_switches += job->usage.involuntary_switches;
+        }
+
+        size_t file_index = 0;
+        for (size_t i = 0; exitcode == 0 && i < files.len; ++file_index)
+        {
+            char const *const filename = &files.ptr[i];
+            i += strlen(filename) + 1;
+
+            dispatch_stamp(d, filename, pending->cmd_hash);
+
+            if (pending->keys.len > 0 && pending->keys.ptr[file_index].valid &&
+                output_cache_store(
+                    d->opts.output_cache,
+                    &pending->keys.ptr[file_index],
+                    filename,
+                    &d->scratch
+                ))
+            {
+                klog(LL_WARN, "Could not cache output of '%s'", filename);
+            }
+        }
+
+        cstrbuf_clear(&pending->files);
+        pending->keys.len = 0;
+    }
+
+    if (d->on_done)
+    {
+        d->on_done(d->on_done_ctx, cmd, exitcode);
+    }
+}
+
+// Check if `filename` is unchanged since `rule`'s command last succeeded
+static bool dispatch_fresh(
+    struct dispatch const *const d,
+    struct rule const *const rule,
+    char const *const filename
+)
+{
+    struct stamp stamp;
+    return stamp_from_file(&stamp, filename, rule_cmd_hash(rule)) &&
+           stamp_db_fresh(d->opts.stamps, filename, &stamp);
+}
+
+// Run `rule`'s command on `files`, which are NUL-terminated filenames
+static enum error run_command( //
+    struct dispatch *const d,
+    struct rule const *const rule,
+    struct sv const files,
+    struct output_key const *const key
+)
+{
+    enum error err = OK;
+
+    if (d->pending.len > 0)
+    {
+        err = pending_job_prepare(d, rule, files, key);
+        if (err)
+        {
+            goto done;
+        }
+    }
+
+    err = command_format(
+        &d->cmd,
+        &d->config->command_segments,
+        &rule->template,
+        files
+    );
+    if (err)
+    {
+        goto done;
+    }
+
+    size_t slot;
+    err = job_pool_run(&d->pool, &d->cmd, &slot);
+    if (!err && d->usages.len > 0)
+    {
+        ++d->usages.ptr[rule - d->config->rules.ptr].started;
+    }
+
+done:
+    return err;
+}
+
+static enum error group_flush(struct dispatch *const d, size_t const index)
+{
+    enum error err = OK;
+    struct group *const group = &d->groups.ptr[index];
+
+    if (group->count > 0)
+    {
+        klog(
+            LL_DEBUG,
+            "Running rule %lu with %lu files",
+            (unsigned long)index,
+            (unsigned long)group->count
+        );
+
+        err = run_command(
+            d,
+            &d->config->rules.ptr[index],
+            sv_from_str(cstrbuf_to_str(group->files)),
+            NULL
+        );
+
+        cstrbuf_clear(&group->files);
+        group->count = 0;
+        group->arg_len = (struct command_arg_len){0};
+    }
+
+    return err;
+}
+
+// Get the length of `group`'s files in the command once `filename` joins them
+static struct command_arg_len group_arg_len_with(
+    struct group const *const group,
+    struct sv const filename
+)
+{
+    struct command_arg_len arg_len = group->arg_len;
+    size_t const sep_len = group->count > 0 ? 1 : 0;
+
+    for (size_t q = 0; q < COMMAND_QUOTING_COUNT; ++q)
+    {
+        arg_len.len[q] += sep_len + command_quoted_len(filename, q);
+    }
+
+    return arg_len;
+}
+
+static enum error group_add( //
+    struct dispatch *const d,
+    size_t const index,
+    char const *const filename
+)
+{
+    enum error err = OK;
+    struct group *const group = &d->groups.ptr[index];
+
+    struct sv const name = sv_from_cstr(filename);
+    struct command_arg_len const arg_len = group_arg_len_with(group, name);
+    size_t const cmd_len = command_template_len(
+        &d->config->rules.ptr[index].template,
+        &arg_len
+    );
+
+    if (group->count > 0 && cmd_len > d->cmd_len_limit)
+    {
+        err = group_flush(d, index);
+        if (err)
+        {
+            goto done;
+        }
+    }
+
+    if (!cstrbuf_extend_cstr(&group->files, filename) ||
+        !da_extend(&group->files, "", 1))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    // Flushing may have emptied the group
+    group->arg_len = group_arg_len_with(group, name);
+    ++group->count;
+
+done:
+    return err;
+}
+
+enum error dispatch_init(
+    struct dispatch *const d,
+    struct config const *const config,
+    struct dispatch_opts const opts
+)
+{
+    enum error err = OK;
+
+    *d = (struct dispatch){
+        .config = config,
+        .opts = opts,
+        .cmd_len_limit = command_len_limit(),
+    };
+
+    err = job_pool_init(&d->pool, opts.jobs);
+    if (err)
+    {
+        goto done;
+    }
+    d->pool.on_start = dispatch_job_start;
+    d->pool.on_done = dispatch_job_done;
+    d->pool.ctx = d;
+
+    trace_name_job_tracks(d->pool.slot_count);
+
+    bool const track =
+        opts.stamps || opts.output_cache || opts.usage || trace_enabled();
+    for (size_t i = 0; track && i < d->pool.slot_count; ++i)
+    {
+        if (!pending_jobs_push(&d->pending, (struct pending_job){0}))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+    for (size_t i = 0; opts.usage && i < config->rules.len; ++i)
+    {
+        if (!rule_usages_push(&d->usages, (struct rule_usage){0}))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+    if (opts.group)
+    {
+        for (size_t i = 0; i < config->rules.len; ++i)
+        {
+            if (!groups_push(&d->groups, (struct group){0}))
+            {
+                err = out_of_memory();
+                goto done;
+            }
+        }
+    }
+
+done:
+    if (err)
+    {
+        dispatch_deinit(d);
+    }
+    return err;
+}
+
+void dispatch_deinit(struct dispatch *const d)
+{
+    for (size_t i = 0; i < d->groups.len; ++i)
+    {
+        cstrbuf_deinit(&d->groups.ptr[i].files);
+    }
+    groups_deinit(&d->groups);
+    // Finishing jobs still use their pending entries
+    job_pool_deinit(&d->pool);
+    for (size_t i = 0; i < d->pending.len; ++i)
+    {
+        pending_job_deinit(&d->pending.ptr[i]);
+    }
+    pending_jobs_deinit(&d->pending);
+    pending_job_deinit(&d->next);
+    rule_usages_deinit(&d->usages);
+    cstrbuf_deinit(&d->cmd);
+    arena_deinit(&d->scratch);
+}
+
+enum error dispatch_file(struct dispatch *const d, char const *const filename)
+{
+    assert(filename);
+
+    enum error err = OK;
+
+    struct rule const *const rule =
+        config_match(d->config, sv_from_cstr(filename));
+
+    if (!rule)
+    {
+        klog(LL_WARN, "Did not find pattern match for '%s'", filename);
+        err = ERR_NO_MATCHES;
+    }
+    else
+    {
+        err = dispatch_matched(d, rule, filename);
+    }
+
+    return err;
+}
+
+enum error dispatch_matched(
+    struct dispatch *const d,
+    struct rule const *const rule,
+    char const *const filename
+)
+{
+    assert(rule);
+    assert(filename);
+
+    enum error err = OK;
+
+    arena_reset(&d->scratch);
+
+    if (d->opts.stamps && dispatch_fresh(d, rule, filename))
+    {
+        klog(LL_DEBUG, "Up to date: %s", filename);
+        goto done;
+    }
+
+    struct output_key key = {0};
+    if (d->opts.output_cache)
+    {
+        output_key_from_file(&key, filename, rule_cmd_hash(rule));
+    }
+
+    if (key.valid)
+    {
+        bool hit;
+        err = output_cache_apply(
+            d->opts.output_cache,
+            &key,
+            filename,
+            &d->scratch,
+            &hit
+        );
+        if (err || hit)
+        {
+            if (hit)
+            {
+                klog(LL_INFO, "Using cached output for '%s'", filename);
+                dispatch_stamp(d, filename, key.cmd_hash);
+            }
+            goto done;
+        }
+    }
+
+    if (d->opts.group)
+    {
+        err = group_add(d, (size_t)(rule - d->config->rules.ptr), filename);
+    }
+    else
+    {
+        struct sv const files = {
+            .ptr = filename,
+            .len = strlen(filename) + 1,
+        };
+        err = run_command(d, rule, files, key.valid ? &key : NULL);
+    }
+
+done:
+    return err;
+}
+
+enum error dispatch_finish(struct dispatch *const d)
+{
+    enum error err = OK;
+
+    for (size_t i = 0; i < d->groups.len; ++i)
+    {
+        error_combine(&err, group_flush(d, i));
+    }
+
+    error_combine(&err, job_pool_wait_all(&d->pool));
+    arena_reset(&d->scratch);
+
+    // Each finished command was charged to the rule that started it
+    for (size_t i = 0; i < d->usages.len; ++i)
+    {
+        assert(d->usages.ptr[i].count == d->usages.ptr[i].started);
+    }
+
+    return err;
+}
+
+void dispatch_print_usage(struct dispatch const *const d)
+{
+    if (d->usages.len == 0)
+    {
+        return;
+    }
+
+    fprintf(
+        stderr,
+        "%4s %8s %10s %10s %12s %10s %10s  %s\n",
+        "rule",
+        "count",
+        "user",
+        "sys",
+        "max rss",
+        "vol cs",
+        "invol cs",
+        "command"
+    );
+
+    for (size_t i = 0; i < d->usages.len; ++i)
+    {
+        struct rule_usage const *const usage = &d->usages.ptr[i];
+        struct job_usage const *const total = &usage->total;
+        struct str const command = d->config->rules.ptr[i].command;
+
+        fprintf(
+            stderr,
+            "%4lu %8llu %9.3fs %9.3fs %9lluKiB %10llu %10llu  %.*s\n",
+            (unsigned long)i,
+            (unsigned long long)usage->count,
+            (double)total->user_ns / 1e9,
+            (double)total->sys_ns / 1e9,
+            (unsigned long long)total->max_rss_kib,
+            (unsigned long long)total->voluntary_switches,
+            (unsigned long long)total->involuntary_switches,
+            str_format_args(command)
+        );
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include "config.h"
+#include "error.h"
+#include "jobs.h"
+#include "krs_arena.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "output_cache.h"
+#include "prexy.h"
+#include "stamp.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Files waiting to be run by one rule (group mode)
+struct group
+{
+    // NUL-terminated filenames
+    struct cstrbuf files;
+    size_t count;
+    // Length of `files` in the command, see `command_arg_len()`
+    struct command_arg_len arg_len;
+};
+
+prexy struct groups
+{
+    struct group *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Files of the command running in a job slot, to stamp and cache once
+// it succeeds
+struct pending_job
+{
+    // NUL-terminated filenames
+    struct cstrbuf files;
+    // Index of the rule, for tracing
+    size_t rule;
+    u64 cmd_hash;
+    // Output key of each file before the command ran, if caching
+    struct output_keys keys;
+};
+
+prexy struct pending_jobs
+{
+    struct pending_job *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Resources used by all commands of a rule
+struct rule_usage
+{
+    // Commands that finished
+    u64 count;
+    // Commands that started, equal to `count` once all have finished
+    u64 started;
+    // Sums, except `max_rss_kib` which is the largest
+    struct job_usage total;
+};
+
+prexy struct rule_usages
+{
+    struct rule_usage *ptr;
+    size_t len;
+    size_t cap;
+};
+
+struct dispatch_opts
+{
+    // Group files by rule and pass many files to each command
+    bool group;
+    // Maximum concurrent commands
+    size_t jobs;
+    // Optional, skips files unchanged since their command last succeeded
+    struct stamp_db *stamps;
+    // Optional, reuses the output of commands run on the same contents
+    struct output_cache const *output_cache;
+    // Sum the resources used by each rule's commands
+    bool usage;
+};
+
+struct dispatch
+{
+    struct config const *config;
+    struct dispatch_opts opts;
+    // Indexed like `config->rules`
+    struct groups groups;
+    size_t cmd_len_limit;
+    struct job_pool pool;
+    // Command formatting scratch buffer
+    struct cstrbuf cmd;
+    // Scratch memory of the file being dispatched, reset for each file
+    struct arena scratch;
+    // Indexed by job slot, empty if no option needs to know which files a
+    // command ran on
+    struct pending_jobs pending;
+    // Indexed like `config->rules`, empty unless `opts.usage` is set
+    struct rule_usages usages;
+    // Entry for the next command, swapped into its slot just before it runs
+    struct pending_job next;
+    // Optional, called as each command finishes (see `job_pool`)
+    void (*on_done)(void *ctx, char const *cmd, int exitcode);
+    void *on_done_ctx;
+};
+
+// `d` must not move until `dispatch_deinit()`
+nodiscard enum error dispatch_init(
+    struct dispatch *d,
+    struct config const *config,
+    struct dispatch_opts opts
+);
+void dispatch_deinit(struct dispatch *d);
+
+// Match `filename` and run its rule's command (or queue it in group mode)
+nodiscard enum error dispatch_file(struct dispatch *d, char const *filename);
+
+// Run `rule`'s command for `filename`, which is already known to match
+nodiscard enum error dispatch_matched(
+    struct dispatch *d,
+    struct rule const *rule,
+    char const *filename
+);
+
+// Run all queued commands and wait for them to finish
+nodiscard enum error dispatch_finish(struct dispatch *d);
+
+// Print the resources used by each rule's commands to stderr, if
+// `opts.usage` is set
+void dispatch_print_usage(struct dispatch const *d);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef PREXY_CLIENT_DISPATCH_H_
+#define PREXY_CLIENT_DISPATCH_H_
+
+/* Generated by prexy from: dispatch.h */
+
+#include "prexy.h"
+
+// prexy struct groups
+// {
+//     struct group *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define groups_X(F)                                                            \
+    F(simple, struct group *, ptr)                                             \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define groups_FIELDTYPE_ptr struct group *
+#define groups_IS_MUT_PTR_ptr 1
+#define groups_IS_CONST_PTR_ptr 0
+#define groups_PTRTYPE_ptr struct group
+#define groups_FIELDTYPE_len size_t
+#define groups_IS_MUT_PTR_len 0
+#define groups_IS_CONST_PTR_len 0
+#define groups_FIELDTYPE_cap size_t
+#define groups_IS_MUT_PTR_cap 0
+#define groups_IS_CONST_PTR_cap 0
+
+// prexy struct pending_jobs
+// {
+//     struct pending_job *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define pending_jobs_X(F)                                                      \
+    F(simple, struct pending_job *, ptr)                                       \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define pending_jobs_FIELDTYPE_ptr struct pending_job *
+#define pending_jobs_IS_MUT_PTR_ptr 1
+#define pending_jobs_IS_CONST_PTR_ptr 0
+#define pending_jobs_PTRTYPE_ptr struct pending_job
+#define pending_jobs_FIELDTYPE_len size_t
+#define pending_jobs_IS_MUT_PTR_len 0
+#define pending_jobs_IS_CONST_PTR_len 0
+#define pending_jobs_FIELDTYPE_cap size_t
+#define pending_jobs_IS_MUT_PTR_cap 0
+#define pending_jobs_IS_CONST_PTR_cap 0
+
+// prexy struct rule_usages
+// {
+//     struct rule_usage *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define rule_usages_X(F)                                                       \
+    F(simple, struct rule_usage *, ptr)                                        \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define rule_usages_FIELDTYPE_ptr struct rule_usage *
+#define rule_usages_IS_MUT_PTR_ptr 1
+#define rule_usages_IS_CONST_PTR_ptr 0
+#define rule_usages_PTRTYPE_ptr struct rule_usage
+#define rule_usages_FIELDTYPE_len size_t
+#define rule_usages_IS_MUT_PTR_len 0
+#define rule_usages_IS_CONST_PTR_len 0
+#define rule_usages_FIELDTYPE_cap size_t
+#define rule_usages_IS_MUT_PTR_cap 0
+#define rule_usages_IS_CONST_PTR_cap 0
+
+#endif
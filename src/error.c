@@ -0,0 +1,16 @@
+#include "error.h"
+#include "krs_log.h"
+
+enum error out_of_memory(void)
+{
+    klog(LL_FATAL, "Out of memory");
+    return ERR_OUT_OF_MEMORY;
+}
+
+void error_combine(enum error *const err, enum error const other)
+{
+    if (!*err)
+    {
+        *err = other;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef ERROR_H_
+#define ERROR_H_
+
+#include "krs_cc_ext.h"
+
+// Process exit codes
+enum error
+{
+    OK = 0,
+    ERR_NO_MATCHES,
+    ERR_FILESYSTEM,
+    ERR_ARGS,
+    ERR_OUT_OF_MEMORY,
+    ERR_SYNTAX,
+    ERR_SPAWN,
+};
+
+// Log an out-of-memory error and return ERR_OUT_OF_MEMORY
+nodiscard enum error out_of_memory(void);
+
+// Keep the first error encountered
+void error_combine(enum error *err, enum error other);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FILE_STAT_H_
+#define FILE_STAT_H_
+
+#ifndef _WIN32
+
+#include <sys/stat.h>
+#include <time.h>
+
+// Modification time of `st`. Darwin names the field `st_mtimespec`.
+static inline struct timespec file_stat_mtime(struct stat const *const st)
+{
+#ifdef __APPLE__
+    return st->st_mtimespec;
+#else
+    return st->st_mtim;
+#endif
+}
+
+#endif
+
+#endif
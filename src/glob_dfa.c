@@ -0,0 +1,458 @@
+#include "glob_dfa.h"
+#include "error.h"
+#include "glob_dfa_prexy.h"
+#include "krs_glob.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define Vec glob_dfa_patterns
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec glob_atoms
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec dfa_u32s
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec dfa_u64s
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define DFA_DEAD_STATE 0
+#define DFA_START_STATE 1
+#define DFA_TABLE_MIN_SLOTS 64
+
+// Subset construction state. Each pattern compiles to its atoms followed
+// by an accepting position, which is an atom with an empty byte set.
+struct dfa_builder
+{
+    // Positions of all patterns
+    struct glob_atoms atoms;
+    // Tag of each position, GLOB_DFA_NO_MATCH if it is not accepting
+    struct dfa_u32s tags;
+    // First position of each pattern
+    struct dfa_u32s starts;
+    // Position set of each state, `words` per state
+    size_t words;
+    struct dfa_u64s sets;
+    // Open addressing table of state index + 1, 0 when unused
+    struct dfa_u32s table;
+    u32 state_count;
+    u32 class_count;
+    u8 byte_class[256];
+    // Representative byte of each class
+    u8 class_byte[256];
+    struct dfa_u32s trans;
+};
+
+static void dfa_builder_deinit(struct dfa_builder *const b)
+{
+    glob_atoms_deinit(&b->atoms);
+    dfa_u32s_deinit(&b->tags);
+    dfa_u32s_deinit(&b->starts);
+    dfa_u64s_deinit(&b->sets);
+    dfa_u32s_deinit(&b->table);
+    dfa_u32s_deinit(&b->trans);
+}
+
+// Compile every pattern into positions. Returns false if one is unsupported.
+static bool dfa_builder_compile(
+    struct dfa_builder *const b,
+    struct glob_dfa_patterns const patterns,
+    enum error *const err
+)
+{
+    bool supported = true;
+
+    for (size_t i = 0; supported && i < patterns.len; ++i)
+    {
+        struct glob_dfa_pattern const p = patterns.ptr[i];
+
+        if (!glob_atoms_reserve(&b->atoms, p.pattern.len + 1) ||
+            !dfa_u32s_reserve(&b->tags, p.pattern.len + 1) ||
+            !dfa_u32s_push(&b->starts, (u32)b->atoms.len))
+        {
+            *err = out_of_memory();
+            supported = false;
+            break;
+        }
+
+        size_t count = 0;
+        supported =
+            glob_compile(p.pattern, &b->atoms.ptr[b->atoms.len], &count);
+
+        if (!supported)
+        {
+            klog(
+                LL_DEBUG,
+                "Pattern '%.*s' not supported by glob automaton",
+                str_format_args(p.pattern)
+            );
+            break;
+        }
+
+        b->atoms.len += count;
+        b->atoms.ptr[b->atoms.len++] = (struct glob_atom){0};
+
+        for (size_t j = 0; j < count; ++j)
+        {
+            b->tags.ptr[b->tags.len++] = GLOB_DFA_NO_MATCH;
+        }
+        b->tags.ptr[b->tags.len++] = p.tag;
+    }
+
+    return supported;
+}
+
+// Partition bytes into classes that every position treats alike
+static void dfa_builder_classify(struct dfa_builder *const b)
+{
+    memset(b->byte_class, 0, sizeof(b->byte_class));
+    b->class_count = 1;
+
+    for (size_t i = 0; i < b->atoms.len; ++i)
+    {
+        struct glob_atom const *const atom = &b->atoms.ptr[i];
+        if (atom->star)
+        {
+            continue;
+        }
+
+        // Split each class by membership in `atom->set`
+        u16 split[256][2];
+        memset(split, 0xff, sizeof(split));
+        u32 count = 0;
+
+        for (size_t c = 0; c < 256; ++c)
+        {
+            bool const has = glob_byteset_has(&atom->set, (unsigned char)c);
+            u16 *const slot = &split[b->byte_class[c]][has ? 1 : 0];
+
+            if (*slot == UINT16_MAX)
+            {
+                *slot = (u16)count++;
+            }
+            b->byte_class[c] = (u8)*slot;
+        }
+
+        b->class_count = count;
+    }
+
+    for (size_t c = 256; c > 0; --c)
+    {
+        b->class_byte[b->byte_class[c - 1]] = (u8)(c - 1);
+    }
+}
+
+// Add positions reachable by skipping stars. Stars are never last, so
+// `i + 1` is always a position of the same pattern.
+static void dfa_builder_close(struct dfa_builder const *const b, u64 *set)
+{
+    for (size_t i = 0; i < b->atoms.len; ++i)
+    {
+        if (((set[i >> 6] >> (i & 63)) & 1) && b->atoms.ptr[i].star)
+        {
+            set[(i + 1) >> 6] |= (u64)1 << ((i + 1) & 63);
+        }
+    }
+}
+
+static u64 *dfa_builder_set(struct dfa_builder const *const b, u32 state)
+{
+    return &b->sets.ptr[(size_t)state * b->words];
+}
+
+static size_t dfa_builder_slot(
+    struct dfa_builder const *const b,
+    u64 const *const set
+)
+{
+    size_t const mask = b->table.len - 1;
+    size_t i = (size_t)hash_fnv1a(HASH_FNV1A_INIT, set, b->words * 8) & mask;
+
+    while (b->table.ptr[i] != 0 &&
+           0 != memcmp(
+                    dfa_builder_set(b, b->table.ptr[i] - 1),
+                    set,
+                    b->words * 8
+                ))
+    {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+// Double the state table and reinsert every state
+static bool dfa_builder_grow_table(struct dfa_builder *const b)
+{
+    size_t const slots =
+        b->table.len ? b->table.len * 2 : DFA_TABLE_MIN_SLOTS;
+
+    b->table.len = 0;
+    if (!dfa_u32s_reserve(&b->table, slots))
+    {
+        return false;
+    }
+    memset(b->table.ptr, 0, slots * sizeof(b->table.ptr[0]));
+    b->table.len = slots;
+
+    for (u32 s = 0; s < b->state_count; ++s)
+    {
+        b->table.ptr[dfa_builder_slot(b, dfa_builder_set(b, s))] = s + 1;
+    }
+
+    return true;
+}
+
+// Get the state for the position set at the end of `sets`, which is
+// dropped if an equal state already exists
+static bool dfa_builder_intern(struct dfa_builder *const b, u32 *const state)
+{
+    u32 const candidate = b->state_count;
+    u64 const *const set = dfa_builder_set(b, candidate);
+    size_t slot = dfa_builder_slot(b, set);
+
+    if (b->table.ptr[slot] != 0)
+    {
+        *state = b->table.ptr[slot] - 1;
+        b->sets.len -= b->words;
+        return true;
+    }
+
+    *state = candidate;
+    b->table.ptr[slot] = candidate + 1;
+    ++b->state_count;
+
+    // Keep load factor at or below 1/2
+    return (size_t)b->state_count * 2 <= b->table.len ||
+           dfa_builder_grow_table(b);
+}
+
+// Append an empty position set to `sets`
+static bool dfa_builder_new_set(struct dfa_builder *const b)
+{
+    if (!dfa_u64s_reserve(&b->sets, b->words))
+    {
+        return false;
+    }
+    memset(&b->sets.ptr[b->sets.len], 0, b->words * sizeof(u64));
+    b->sets.len += b->words;
+    return true;
+}
+
+// Run the subset construction. Returns false if it exceeds `max_states`.
+static bool dfa_builder_run(
+    struct dfa_builder *const b,
+    u32 const max_states,
+    enum error *const err
+)
+{
+    b->words = (b->atoms.len + 63) / 64;
+
+    if (!dfa_builder_grow_table(b))
+    {
+        goto oom;
+    }
+
+    u32 state;
+
+    // Dead state
+    if (!dfa_builder_new_set(b) || !dfa_builder_intern(b, &state))
+    {
+        goto oom;
+    }
+    assert(state == DFA_DEAD_STATE);
+
+    if (!dfa_builder_new_set(b))
+    {
+        goto oom;
+    }
+    for (size_t i = 0; i < b->starts.len; ++i)
+    {
+        u32 const p = b->starts.ptr[i];
+        b->sets.ptr[b->sets.len - b->words + (p >> 6)] |= (u64)1 << (p & 63);
+    }
+    dfa_builder_close(b, dfa_builder_set(b, b->state_count));
+    if (!dfa_builder_intern(b, &state))
+    {
+        goto oom;
+    }
+    assert(state == DFA_START_STATE);
+
+    // States are numbered in discovery order, so this visits each one once
+    for (u32 s = 0; s < b->state_count; ++s)
+    {
+        if (!dfa_u32s_reserve(&b->trans, b->class_count))
+        {
+            goto oom;
+        }
+
+        for (u32 cls = 0; cls < b->class_count; ++cls)
+        {
+            unsigned char const c = b->class_byte[cls];
+
+            if (!dfa_builder_new_set(b))
+            {
+                goto oom;
+            }
+
+            u64 const *const from = dfa_builder_set(b, s);
+            u64 *const to = dfa_builder_set(b, b->state_count);
+
+            for (size_t i = 0; i < b->atoms.len; ++i)
+            {
+                if (!from[i >> 6])
+                {
+                    // Skip the rest of an empty word
+                    i |= 63;
+                    continue;
+                }
+                if (!((from[i >> 6] >> (i & 63)) & 1))
+                {
+                    continue;
+                }
+
+                struct glob_atom const *const atom = &b->atoms.ptr[i];
+                if (atom->star)
+                {
+                    to[i >> 6] |= (u64)1 << (i & 63);
+                }
+                else if (glob_byteset_has(&atom->set, c))
+                {
+                    to[(i + 1) >> 6] |= (u64)1 << ((i + 1) & 63);
+                }
+            }
+
+            dfa_builder_close(b, to);
+
+            if (!dfa_builder_intern(b, &state))
+            {
+                goto oom;
+            }
+            if (b->state_count > max_states)
+            {
+                klog(
+                    LL_DEBUG,
+                    "Glob automaton exceeds %lu states",
+                    (unsigned long)max_states
+                );
+                return false;
+            }
+
+            b->trans.ptr[b->trans.len++] = state;
+        }
+    }
+
+    return true;
+
+oom:
+    *err = out_of_memory();
+    return false;
+}
+
+enum error glob_dfa_build(
+    struct glob_dfa *const dfa,
+    struct glob_dfa_patterns const patterns,
+    u32 const max_states
+)
+{
+    enum error err = OK;
+
+    *dfa = (struct glob_dfa){0};
+
+    struct dfa_builder b = {0};
+
+    if (patterns.len == 0 || !dfa_builder_compile(&b, patterns, &err))
+    {
+        goto done;
+    }
+
+    dfa_builder_classify(&b);
+
+    if (!dfa_builder_run(&b, max_states, &err))
+    {
+        goto done;
+    }
+
+    u32 *const accept = malloc(b.state_count * sizeof(accept[0]));
+    if (!accept)
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    for (u32 s = 0; s < b.state_count; ++s)
+    {
+        u64 const *const set = dfa_builder_set(&b, s);
+
+        accept[s] = GLOB_DFA_NO_MATCH;
+        for (size_t i = 0; i < b.atoms.len; ++i)
+        {
+            if ((set[i >> 6] >> (i & 63)) & 1)
+            {
+                accept[s] = MIN(accept[s], b.tags.ptr[i]);
+            }
+        }
+    }
+
+    *dfa = (struct glob_dfa){
+        .state_count = b.state_count,
+        .class_count = b.class_count,
+        .trans = b.trans.ptr,
+        .accept = accept,
+    };
+    memcpy(dfa->byte_class, b.byte_class, sizeof(dfa->byte_class));
+
+    // Ownership moved to `dfa`
+    b.trans = (struct dfa_u32s){0};
+
+    klog(
+        LL_DEBUG,
+        "Built glob automaton: %lu patterns, %lu states, %lu byte classes",
+        (unsigned long)patterns.len,
+        (unsigned long)dfa->state_count,
+        (unsigned long)dfa->class_count
+    );
+
+done:
+    dfa_builder_deinit(&b);
+    return err;
+}
+
+void glob_dfa_deinit(struct glob_dfa *const dfa)
+{
+    if (!dfa->borrowed)
+    {
+        free(dfa->trans);
+        free(dfa->accept);
+    }
+    *dfa = (struct glob_dfa){0};
+}
+
+u32 glob_dfa_match(struct glob_dfa const *const dfa, struct sv const name)
+{
+    assert(dfa->state_count > 0);
+
+    u32 state = DFA_START_STATE;
+
+    for (size_t i = 0; i < name.len && state != DFA_DEAD_STATE; ++i)
+    {
+        u8 const cls = dfa->byte_class[(unsigned char)name.ptr[i]];
+        state = dfa->trans[(size_t)state * dfa->class_count + cls];
+    }
+
+    return dfa->accept[state];
+}
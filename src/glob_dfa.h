@@ -0,0 +1,80 @@
+#ifndef GLOB_DFA_H_
+#define GLOB_DFA_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_glob.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GLOB_DFA_NO_MATCH UINT32_MAX
+
+// Glob pattern tagged with the value returned when it matches
+struct glob_dfa_pattern
+{
+    struct sv pattern;
+    u32 tag;
+};
+
+prexy struct glob_dfa_patterns
+{
+    struct glob_dfa_pattern *ptr;
+    size_t len;
+    size_t cap;
+};
+
+prexy struct glob_atoms
+{
+    struct glob_atom *ptr;
+    size_t len;
+    size_t cap;
+};
+
+prexy struct dfa_u32s
+{
+    u32 *ptr;
+    size_t len;
+    size_t cap;
+};
+
+prexy struct dfa_u64s
+{
+    u64 *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Deterministic automaton matching many glob patterns in one pass.
+// State 0 is the dead state and state 1 is the start state.
+struct glob_dfa
+{
+    // Zero if the automaton was not built
+    u32 state_count;
+    u32 class_count;
+    // Bytes that no pattern distinguishes share a class
+    u8 byte_class[256];
+    // Next state, indexed by `state * class_count + class`
+    u32 *trans;
+    // Lowest tag of the patterns accepted in each state
+    u32 *accept;
+    // Tables are owned by someone else, e.g. a mapped file
+    bool borrowed;
+};
+
+// Build an automaton for `patterns`. Leaves `dfa->state_count` zero if
+// a pattern is not supported by `glob_compile()` or the automaton would
+// need more than `max_states` states.
+nodiscard enum error glob_dfa_build(
+    struct glob_dfa *dfa,
+    struct glob_dfa_patterns patterns,
+    u32 max_states
+);
+void glob_dfa_deinit(struct glob_dfa *dfa);
+
+// Get the lowest tag of the patterns matching `name`, or GLOB_DFA_NO_MATCH
+nodiscard u32 glob_dfa_match(struct glob_dfa const *dfa, struct sv name);
+
+#endif
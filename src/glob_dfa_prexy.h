@@ -0,0 +1,96 @@
+#ifndef PREXY_CLIENT_GLOB_DFA_H_
+#define PREXY_CLIENT_GLOB_DFA_H_
+
+/* Generated by prexy from: glob_dfa.h */
+
+#include "prexy.h"
+
+// prexy struct glob_dfa_patterns
+// {
+//     struct glob_dfa_pattern *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define glob_dfa_patterns_X(F)                                                 \
+    F(simple, struct glob_dfa_pattern *, ptr)                                  \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define glob_dfa_patterns_FIELDTYPE_ptr struct glob_dfa_pattern *
+#define glob_dfa_patterns_IS_MUT_PTR_ptr 1
+#define glob_dfa_patterns_IS_CONST_PTR_ptr 0
+#define glob_dfa_patterns_PTRTYPE_ptr struct glob_dfa_pattern
+#define glob_dfa_patterns_FIELDTYPE_len size_t
+#define glob_dfa_patterns_IS_MUT_PTR_len 0
+#define glob_dfa_patterns_IS_CONST_PTR_len 0
+#define glob_dfa_patterns_FIELDTYPE_cap size_t
+#define glob_dfa_patterns_IS_MUT_PTR_cap 0
+#define glob_dfa_patterns_IS_CONST_PTR_cap 0
+
+// prexy struct glob_atoms
+// {
+//     struct glob_atom *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define glob_atoms_X(F)                                                        \
+    F(simple, struct glob_atom *, ptr)                                         \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define glob_atoms_FIELDTYPE_ptr struct glob_atom *
+#define glob_atoms_IS_MUT_PTR_ptr 1
+#define glob_atoms_IS_CONST_PTR_ptr 0
+#define glob_atoms_PTRTYPE_ptr struct glob_atom
+#define glob_atoms_FIELDTYPE_len size_t
+#define glob_atoms_IS_MUT_PTR_len 0
+#define glob_atoms_IS_CONST_PTR_len 0
+#define glob_atoms_FIELDTYPE_cap size_t
+#define glob_atoms_IS_MUT_PTR_cap 0
+#define glob_atoms_IS_CONST_PTR_cap 0
+
+// prexy struct dfa_u32s
+// {
+//     u32 *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define dfa_u32s_X(F)                                                          \
+    F(simple, u32 *, ptr)                                                      \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define dfa_u32s_FIELDTYPE_ptr u32 *
+#define dfa_u32s_IS_MUT_PTR_ptr 1
+#define dfa_u32s_IS_CONST_PTR_ptr 0
+#define dfa_u32s_PTRTYPE_ptr u32
+#define dfa_u32s_FIELDTYPE_len size_t
+#define dfa_u32s_IS_MUT_PTR_len 0
+#define dfa_u32s_IS_CONST_PTR_len 0
+#define dfa_u32s_FIELDTYPE_cap size_t
+#define dfa_u32s_IS_MUT_PTR_cap 0
+#define dfa_u32s_IS_CONST_PTR_cap 0
+
+// prexy struct dfa_u64s
+// {
+//     u64 *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define dfa_u64s_X(F)                                                          \
+    F(simple, u64 *, ptr)                                                      \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define dfa_u64s_FIELDTYPE_ptr u64 *
+#define dfa_u64s_IS_MUT_PTR_ptr 1
+#define dfa_u64s_IS_CONST_PTR_ptr 0
+#define dfa_u64s_PTRTYPE_ptr u64
+#define dfa_u64s_FIELDTYPE_len size_t
+#define dfa_u64s_IS_MUT_PTR_len 0
+#define dfa_u64s_IS_CONST_PTR_len 0
+#define dfa_u64s_FIELDTYPE_cap size_t
+#define dfa_u64s_IS_MUT_PTR_cap 0
+#define dfa_u64s_IS_CONST_PTR_cap 0
+
+#endif
@@ -0,0 +1,439 @@
+#include "jobs.h"
+#include "error.h"
+#include "jobs_prexy.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "prexy.h"
+#include "timings.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// Characters that need /bin/sh to interpret the command
+#define SHELL_METACHARS "|&;<>()$`\\\"'*?[]{}#~!\n"
+#define SHELL_WORD_DELIMS " \t"
+
+// POSIX special and regular builtins, which go to /bin/sh. Some are not
+// programs on PATH, and others only act on the shell that runs them.
+static char const *const shell_builtins[] = {
+    ".",        ":",        "alias",    "bg",       "break",    "cd",
+    "command",  "continue", "eval",     "exec",     "exit",     "export",
+    "false",    "fc",       "fg",       "getopts",  "hash",     "jobs",
+    "kill",     "newgrp",   "pwd",      "read",     "readonly", "return",
+    "set",      "shift",    "times",    "trap",     "true",     "type",
+    "ulimit",   "umask",    "unalias",  "unset",    "wait",
+};
+#endif
+
+#define Vec argv
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+size_t job_pool_default_size(void)
+{
+#ifdef _WIN32
+    return 1;
+#else
+    long const n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+enum error job_pool_init(struct job_pool *const pool, size_t const max_jobs)
+{
+    assert(max_jobs > 0);
+
+    enum error err = OK;
+
+    *pool = (struct job_pool){0};
+
+    pool->slots = malloc(max_jobs * sizeof(pool->slots[0]));
+    if (!pool->slots)
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    for (size_t i = 0; i < max_jobs; ++i)
+    {
+        pool->slots[i] = (struct job){0};
+    }
+    pool->slot_count = max_jobs;
+
+done:
+    return err;
+}
+
+void job_pool_deinit(struct job_pool *const pool)
+{
+    (void)!job_pool_wait_all(pool);
+
+    for (size_t i = 0; i < pool->slot_count; ++i)
+    {
+        cstrbuf_deinit(&pool->slots[i].cmd);
+    }
+    cstrbuf_deinit(&pool->args);
+    argv_deinit(&pool->argv);
+
+    if (pool->slots)
+    {
+        free(pool->slots);
+    }
+}
+
+#ifdef _WIN32
+
+enum error job_pool_run(
+    struct job_pool *const pool,
+    struct cstrbuf *const cmd,
+    size_t *const slot
+)
+{
+    *slot = 0;
+
+    if (pool->on_start)
+    {
+        pool->on_start(pool->ctx, 0);
+    }
+
+    klog(LL_INFO, "Running: %s", cmd->ptr);
+    pool->slots[0].start = timings_start();
+    int exitcode = system(cmd->ptr);
+
+    if (exitcode != 0)
+    {
+        klog(LL_WARN, "Command non-zero exit code: %d", exitcode);
+    }
+
+    if (pool->on_done)
+    {
+        pool->on_done(pool->ctx, 0, cmd->ptr, exitcode);
+    }
+
+    cstrbuf_clear(cmd);
+    return OK;
+}
+
+enum error job_pool_wait_all(struct job_pool *const pool)
+{
+    (void)pool;
+    return OK;
+}
+
+#else
+
+// Log an unsuccessful wait status and get the exit code
+static int job_report_status(struct job const *const job, int const status)
+{
+    int exitcode = 0;
+
+    if (WIFEXITED(status))
+    {
+        exitcode = WEXITSTATUS(status);
+        if (exitcode != 0)
+        {
+            klog(
+                LL_WARN,
+                "Command non-zero exit code: %d: %s",
+                exitcode,
+                job->cmd.ptr
+            );
+        }
+    }
+    else if (WIFSIGNALED(status))
+    {
+        exitcode = 128 + WTERMSIG(status);
+        klog(
+            LL_WARN,
+            "Command killed by signal %d: %s",
+            WTERMSIG(status),
+            job->cmd.ptr
+        );
+    }
+
+    return exitcode;
+}
+
+static u64 job_timeval_ns(struct timeval const tv)
+{
+    return (u64)tv.tv_sec * 1000000000u + (u64)tv.tv_usec * 1000u;
+}
+
+static struct job_usage job_usage_from_rusage(struct rusage const *const ru)
+{
+    struct job_usage usage = {
+        .user_ns = job_timeval_ns(ru->ru_utime),
+        .sys_ns = job_timeval_ns(ru->ru_stime),
+        .max_rss_kib = (u64)ru->ru_maxrss,
+        .voluntary_switches = (u64)ru->ru_nvcsw,
+        .involuntary_switches = (u64)ru->ru_nivcsw,
+    };
+
+#ifdef __APPLE__
+    // Reported in bytes rather than KiB
+    usage.max_rss_kib /= 1024;
+#endif
+
+    return usage;
+}
+
+// Reap one finished child. Returns false if none was reaped.
+static bool job_pool_reap(struct job_pool *const pool, bool const block)
+{
+    int status;
+    struct rusage ru;
+    pid_t pid;
+
+    u64 const start = block ? timings_start() : 0;
+
+    do
+    {
+        pid = wait4(-1, &status, block ? 0 : WNOHANG, &ru);
+    } while (pid < 0 && errno == EINTR);
+
+    timings_record(TIMING_WAIT, start, sv_empty());
+
+    bool const reaped = pid > 0;
+
+    if (reaped)
+    {
+        for (size_t i = 0; i < pool->slot_count; ++i)
+        {
+            struct job *const job = &pool->slots[i];
+
+            if (job->pid == pid)
+            {
+                job->usage = job_usage_from_rusage(&ru);
+                klog(
+                    LL_DEBUG,
+                    "Job %lu finished: user %.3fs, sys %.3fs, max RSS %llu "
+                    "KiB, %llu voluntary and %llu involuntary context "
+                    "switches",
+                    (unsigned long)i,
+                    (double)job->usage.user_ns / 1e9,
+                    (double)job->usage.sys_ns / 1e9,
+                    (unsigned long long)job->usage.max_rss_kib,
+                    (unsigned long long)job->usage.voluntary_switches,
+                    (unsigned long long)job->usage.involuntary_switches
+                );
+                int const exitcode = job_report_status(job, status);
+                if (pool->on_done)
+                {
+                    pool->on_done(
+                        pool->ctx,
+                        i,
+                        job->cmd.ptr,
+                        exitcode
+                    );
+                }
+
+                job->pid = 0;
+                cstrbuf_clear(&job->cmd);
+                --pool->running;
+                break;
+            }
+        }
+    }
+
+    return reaped;
+}
+
+// Split `cmd` into `pool->argv` if it can be run without a shell
+static enum error job_pool_split_argv( //
+    struct job_pool *const pool,
+    char const *const cmd,
+    bool *const out_split
+)
+{
+    enum error err = OK;
+
+    *out_split = false;
+
+    if (strpbrk(cmd, SHELL_METACHARS))
+    {
+        goto done;
+    }
+
+    // Leading `VAR=value` is a shell variable assignment
+    size_t const first_word_len = strcspn(cmd, SHELL_WORD_DELIMS);
+    if (memchr(cmd, '=', first_word_len))
+    {
+        goto done;
+    }
+
+    struct sv const first_word = {.ptr = cmd, .len = first_word_len};
+    for (size_t i = 0; i < ARRAY_LENGTH(shell_builtins); ++i)
+    {
+        if (sv_equal_cstr(first_word, shell_builtins[i]))
+        {
+            goto done;
+        }
+    }
+
+    cstrbuf_clear(&pool->args);
+    pool->argv.len = 0;
+
+    if (!cstrbuf_extend_cstr(&pool->args, cmd))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    char *saveptr = NULL;
+    char *word = strtok_r(pool->args.ptr, SHELL_WORD_DELIMS, &saveptr);
+    while (word)
+    {
+        if (!argv_push(&pool->argv, word))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+        word = strtok_r(NULL, SHELL_WORD_DELIMS, &saveptr);
+    }
+
+    if (!argv_push(&pool->argv, NULL))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    *out_split = pool->argv.len > 1;
+
+done:
+    return err;
+}
+
+// Start `cmd` directly if possible, otherwise via /bin/sh
+static enum error job_pool_spawn( //
+    struct job_pool *const pool,
+    char *const cmd,
+    pid_t *const pid
+)
+{
+    static char sh_arg[] = "sh";
+    static char c_arg[] = "-c";
+
+    bool direct;
+    enum error err = job_pool_split_argv(pool, cmd, &direct);
+    if (err)
+    {
+        goto done;
+    }
+
+    int rc;
+
+    if (direct)
+    {
+        klog(LL_DEBUG, "Spawning directly: %s", pool->argv.ptr[0]);
+        rc = posix_spawnp(
+            pid,
+            pool->argv.ptr[0],
+            NULL,
+            NULL,
+            pool->argv.ptr,
+            environ
+        );
+
+        // Let sh find it or report it, as `system()` would
+        direct = rc != ENOENT;
+    }
+
+    if (!direct)
+    {
+        klog(LL_DEBUG, "Spawning via /bin/sh");
+        char *const argv[] = {sh_arg, c_arg, cmd, NULL};
+        rc = posix_spawn(pid, "/bin/sh", NULL, NULL, argv, environ);
+    }
+
+    if (rc != 0)
+    {
+        klog(LL_ERROR, "Failed to run '%s': %s", cmd, strerror(rc));
+        err = ERR_SPAWN;
+    }
+
+done:
+    return err;
+}
+
+enum error job_pool_run(
+    struct job_pool *const pool,
+    struct cstrbuf *const cmd,
+    size_t *const slot
+)
+{
+    assert(cmd->ptr);
+
+    enum error err = OK;
+
+    while (pool->running > 0 && job_pool_reap(pool, false))
+    {
+    }
+    while (pool->running == pool->slot_count && job_pool_reap(pool, true))
+    {
+    }
+
+    struct job *job = NULL;
+    for (size_t i = 0; i < pool->slot_count; ++i)
+    {
+        if (pool->slots[i].pid == 0)
+        {
+            job = &pool->slots[i];
+            *slot = i;
+            klog(LL_DEBUG, "Job %lu starting", (unsigned long)i);
+            break;
+        }
+    }
+    assert(job);
+
+    if (pool->on_start)
+    {
+        pool->on_start(pool->ctx, *slot);
+    }
+
+    klog(LL_INFO, "Running: %s", cmd->ptr);
+
+    pid_t pid;
+    u64 const start = timings_start();
+    err = job_pool_spawn(pool, cmd->ptr, &pid);
+    timings_record(TIMING_SPAWN, start, sv_from_str(cstrbuf_to_str(*cmd)));
+    if (err)
+    {
+        cstrbuf_clear(cmd);
+        goto done;
+    }
+
+    // Swap buffers so the caller gets a cleared one back
+    struct cstrbuf const free_buf = job->cmd;
+    job->cmd = *cmd;
+    *cmd = free_buf;
+
+    job->pid = pid;
+    job->start = start;
+    ++pool->running;
+
+done:
+    return err;
+}
+
+enum error job_pool_wait_all(struct job_pool *const pool)
+{
+    while (pool->running > 0 && job_pool_reap(pool, true))
+    {
+    }
+
+    return OK;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+#include <stddef.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+// Resources used by a finished command and its waited-for children. Zero
+// where the platform does not report them.
+struct job_usage
+{
+    u64 user_ns;
+    u64 sys_ns;
+    // Peak resident set size
+    u64 max_rss_kib;
+    u64 voluntary_switches;
+    u64 involuntary_switches;
+};
+
+// A running command
+struct job
+{
+#ifndef _WIN32
+    pid_t pid;
+#endif
+    // Formatted command line (empty when slot is free)
+    struct cstrbuf cmd;
+    // When the command started, if measuring timings or tracing
+    u64 start;
+    // Set when the command finishes, before `on_done` is called
+    struct job_usage usage;
+};
+
+// NULL-terminated argument list
+prexy struct argv
+{
+    char **ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Runs up to `slot_count` commands concurrently
+struct job_pool
+{
+    struct job *slots;
+    size_t slot_count;
+    size_t running;
+    // Scratch for splitting commands that do not need a shell
+    struct cstrbuf args;
+    struct argv argv;
+    // Optional, called with the slot index of each command once its slot is
+    // free and before it starts
+    void (*on_start)(void *ctx, size_t slot);
+    // Optional, called as each command finishes with its slot index and
+    // exit code (128 + signal number if it was killed)
+    void (*on_done)(void *ctx, size_t slot, char const *cmd, int exitcode);
+    // Passed to `on_start` and `on_done`
+    void *ctx;
+};
+
+// Number of online processors (at least 1)
+nodiscard size_t job_pool_default_size(void);
+
+nodiscard enum error job_pool_init(struct job_pool *pool, size_t max_jobs);
+void job_pool_deinit(struct job_pool *pool);
+
+// Start `cmd`, first waiting for a free slot if all are busy, and set
+// `*slot` to the slot it runs in.
+// Takes ownership of `cmd`, which is swapped for an empty buffer.
+nodiscard enum error job_pool_run(
+    struct job_pool *pool,
+    struct cstrbuf *cmd,
+    size_t *slot
+);
+
+// Wait for all running commands to finish
+nodiscard enum error job_pool_wait_all(struct job_pool *pool);
+
+#endif
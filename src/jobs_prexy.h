@@ -0,0 +1,30 @@
+#ifndef PREXY_CLIENT_JOBS_H_
+#define PREXY_CLIENT_JOBS_H_
+
+/* Generated by prexy from: jobs.h */
+
+#include "prexy.h"
+
+// prexy struct argv
+// {
+//     char **ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define argv_X(F)                                                              \
+    F(simple, char **, ptr)                                                    \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define argv_FIELDTYPE_ptr char **
+#define argv_IS_MUT_PTR_ptr 1
+#define argv_IS_CONST_PTR_ptr 0
+#define argv_PTRTYPE_ptr char *
+#define argv_FIELDTYPE_len size_t
+#define argv_IS_MUT_PTR_len 0
+#define argv_IS_CONST_PTR_len 0
+#define argv_FIELDTYPE_cap size_t
+#define argv_IS_MUT_PTR_cap 0
+#define argv_IS_CONST_PTR_cap 0
+
+#endif
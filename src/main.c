@@ -1,608 +1,407 @@
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+#include "jobs.h"
 #include "krs_cliopt.h"
+#include "krs_dynamic_array.h"
 #include "krs_log.h"
 #include "krs_str.h"
-#include "krs_to_cstr.h"
 #include "krs_types.h"
 #include "main_prexy.h"
+#include "output_cache.h"
+#include "path_reader.h"
 #include "prexy.h"
+#include "serve.h"
+#include "stamp.h"
+#include "timings.h"
+#include "trace.h"
+#include "walk.h"
+#include "watch.h"
 
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef _WIN32
-#include <shlwapi.h>
-
-static int fnmatch(char const *pattern, char const *string, int flags)
-{
-    (void)flags;
-    return PathMatchSpecA(string, pattern) ? 0 : 1;
-}
-
-#else
-#include <fnmatch.h>
-#endif
-
 #define DEFAULT_CONFIG_FILENAME "fnmar.txt"
 
-enum error
-{
-    OK = 0,
-    ERR_NO_MATCHES,
-    ERR_FILESYSTEM,
-    ERR_ARGS,
-    ERR_OUT_OF_MEMORY,
-};
-
-static enum error out_of_memory(void)
+prexy struct cli
 {
-    klog(LL_FATAL, "Out of memory");
-    return ERR_OUT_OF_MEMORY;
-}
+    struct cliopt_strs filename;
 
-static enum error cstrbuf_init_from_file( //
-    struct cstrbuf *const cstrbuf,
-    char const *const filepath
-)
-{
-    enum error err = OK;
+    px_attr(
+        cliopt,
+        .name = "--config",
+        .short_name = 'c',
+        .help = "Config file (default: " DEFAULT_CONFIG_FILENAME ")"
+    );
+    char const *config_filename;
 
-    FILE *file = fopen(filepath, "rb");
-    if (!file)
-    {
-        perror(filepath);
-        err = ERR_FILESYSTEM;
-        goto done;
-    }
+    px_attr(
+        cliopt,
+        .name = "--verbose",
+        .short_name = 'v',
+        .help = "Print debug messages"
+    );
+    bool verbose;
 
-    fseek(file, 0, SEEK_END);
-    size_t const len = (size_t)ftell(file);
-    fseek(file, 0, SEEK_SET);
+    px_attr(
+        cliopt,
+        .name = "--group",
+        .short_name = 'g',
+        .help = "Run each command once with all of its matched files"
+    );
+    bool group;
 
-    char *buf = malloc(len + 1);
-    if (!buf)
-    {
-        err = out_of_memory();
-        goto done;
-    }
+    px_attr(
+        cliopt,
+        .name = "--jobs",
+        .short_name = 'j',
+        .argname = "N",
+        .help = "Max concurrent commands (default: number of CPUs)"
+    );
+    i64 jobs;
 
-    size_t bytes_read = fread(buf, 1, len, file);
-    assert(bytes_read == len);
-    buf[bytes_read] = '\0';
+    px_attr(
+        cliopt,
+        .name = "--cache",
+        .help = "Reuse a compiled copy of the config file (CONFIG.cache)"
+    );
+    bool cache;
 
-    *cstrbuf = (struct cstrbuf){
-        .ptr = buf,
-        .len = len,
-        .cap = len,
-    };
+    px_attr(
+        cliopt,
+        .name = "--stamps",
+        .argname = "FILE",
+        .help = "Skip files unchanged since their command last succeeded"
+    );
+    char const *stamps_path;
 
-done:
-    if (file)
-    {
-        fclose(file);
-    }
-    return err;
-}
+    px_attr(
+        cliopt,
+        .name = "--output-cache",
+        .argname = "DIR",
+        .help = "Reuse what commands left in files with the same contents"
+    );
+    char const *output_cache_dir;
 
-prexy enum token_kind {
-    TOK_NONE,
-    TOK_COMMENT,
-    TOK_PATTERN,
-    TOK_SEMI,
-    TOK_COLON,
-    TOK_CMD,
-    TOK_EOF,
-};
-static prexy_impl(token_kind, to_cstr);
+    px_attr(
+        cliopt,
+        .name = "--serve",
+        .sufficient = true,
+        .help = "Run as a server for clients using --socket"
+    );
+    bool serve;
 
-struct token
-{
-    enum token_kind kind;
-    struct str str;
-};
+    px_attr(
+        cliopt,
+        .name = "--socket",
+        .argname = "PATH",
+        .help = "Unix socket of the server, if one is running"
+    );
+    char const *socket_path;
 
-static enum token_kind get_delim_kind(char const c)
-{
-    enum token_kind kind;
+    px_attr(
+        cliopt,
+        .name = "--recursive",
+        .short_name = 'r',
+        .argname = "DIR",
+        .sufficient = true,
+        .help = "Also run on every matching file under DIR"
+    );
+    char const *recursive;
 
-    switch (c)
-    {
-    case ';':
-        kind = TOK_SEMI;
-        break;
-    case ':':
-        kind = TOK_COLON;
-        break;
-    default:
-        kind = TOK_NONE;
-        break;
-    }
+    px_attr(
+        cliopt,
+        .name = "--watch",
+        .short_name = 'w',
+        .argname = "DIR",
+        .sufficient = true,
+        .help = "Keep running on matching files under DIR as they change"
+    );
+    char const *watch;
 
-    return kind;
-}
+    px_attr(
+        cliopt,
+        .name = "--debounce",
+        .argname = "MS",
+        .help = "Wait for writes to a watched file to stop (default: 100)"
+    );
+    i64 debounce;
 
-static struct token parse_line_start(struct str input, struct str *const tail)
-{
-    struct token token = {0};
+    px_attr(
+        cliopt,
+        .name = "--timings",
+        .help = "Print how long each phase and rule took on exit"
+    );
+    bool timings;
 
-    input = str_trim_left_whitespace(input);
+    px_attr(
+        cliopt,
+        .name = "--trace",
+        .argname = "FILE",
+        .help = "Write a Chrome trace of config, matching and commands"
+    );
+    char const *trace_path;
 
-    if (input.len == 0)
-    {
-        token.kind = TOK_EOF;
-        *tail = input;
-    }
-    else if (input.ptr[0] == '#')
-    {
-        token.kind = TOK_COMMENT;
-        str_split_at_delims(input, "\r\n", &token.str, tail);
-    }
-    else
-    {
-        token.kind = TOK_NONE;
-        *tail = input;
-    }
+    px_attr(
+        cliopt,
+        .name = "--stdin",
+        .sufficient = true,
+        .help = "Also read newline-separated filenames from stdin"
+    );
+    bool read_stdin;
 
-    return token;
-}
+    px_attr(
+        cliopt,
+        .name = "--null",
+        .short_name = '0',
+        .sufficient = true,
+        .help = "Read NUL-separated filenames from stdin (implies --stdin)"
+    );
+    bool null_delim;
+};
+static prexy_impl_attr(cli, cliopt_from_args, cliopt);
 
-static struct token parse_pattern_delim( //
-    struct str input,
-    struct str *const tail
-)
+// Dispatch each filename from stdin as soon as it is read
+static enum error dispatch_stdin(struct dispatch *const d, char const delim)
 {
-    struct token token = {0};
+    enum error err = OK;
 
-    input = str_trim_left_whitespace(input);
+    struct path_reader reader;
+    path_reader_init(&reader, fileno(stdin), delim);
 
-    if (input.len == 0)
+    for (;;)
     {
-        token.kind = TOK_EOF;
-        *tail = input;
-    }
-    else
-    {
-        token.kind = get_delim_kind(input.ptr[0]);
-        if (token.kind)
+        char const *filename;
+        enum error const read_err = path_reader_next(&reader, &filename);
+        if (read_err)
         {
-            token.str = (struct str){
-                .ptr = input.ptr,
-                .len = 1,
-            };
-            *tail = (struct str){
-                .ptr = &input.ptr[1],
-                .len = input.len - 1,
-            };
+            error_combine(&err, read_err);
+            break;
         }
-        else
+
+        if (!filename)
         {
-            *tail = input;
+            break;
         }
+
+        error_combine(&err, dispatch_file(d, filename));
     }
 
-    return token;
+    path_reader_deinit(&reader);
+    return err;
 }
 
-static struct token parse_pattern(struct str input, struct str *const tail)
+int main(int const argc, char const *const *const argv)
 {
-    struct token token = {0};
-
-    input = str_trim_left_whitespace(input);
+    enum error err = OK;
 
-    if (input.len == 0)
-    {
-        token.kind = TOK_EOF;
-        *tail = input;
-    }
-    else
-    {
-        str_split_at_delims(input, ";:\r\n", &token.str, tail);
-        token.str = str_trim_whitespace(token.str);
-        if (token.str.len > 0)
-        {
-            token.kind = TOK_PATTERN;
-        }
-        else
-        {
-            token = parse_pattern_delim(input, tail);
-        }
-    }
+    log_setup_from_env();
 
-    return token;
-}
+    struct cli cli = {
+        .config_filename = DEFAULT_CONFIG_FILENAME,
+        .debounce = WATCH_DEFAULT_DEBOUNCE_MS,
+    };
 
-static struct token parse_command(struct str input, struct str *const tail)
-{
-    struct token token = {0};
+    // Kept absolute while serving, see `serve_absolute_path()`
+    struct cstrbuf stamps_path = {0};
+    struct cstrbuf output_cache_dir = {0};
 
-    input = str_trim_left_char(input, ' ');
+    struct cliopt_prog const progopts = {
+        .name = "fnmar",
+    };
 
-    if (input.len == 0)
+    if (!cli_from_args(&cli, argc, argv, progopts))
     {
-        token.kind = TOK_EOF;
-        *tail = input;
+        err = ERR_ARGS;
+        goto done;
     }
-    else
+
+    if (cli.verbose)
     {
-        str_split_at_delims(input, "\r\n", &token.str, tail);
-        token.str = str_trim_whitespace(token.str);
-        if (token.str.len > 0)
-        {
-            token.kind = TOK_CMD;
-        }
-        else
-        {
-            token.kind = TOK_NONE;
-        }
+        log_set_level(LL_DEBUG);
     }
 
-    return token;
-}
-
-struct file_pos
-{
-    // Zero-indexed line number
-    u32 line;
-    // Zero-indexed column number
-    u32 column;
-};
-
-static struct file_pos find_file_pos( //
-    struct str const text,
-    char const *const ptr
-)
-{
-    assert(ptr != NULL);
-    assert(text.ptr <= ptr);
-    assert((size_t)(ptr - text.ptr) < text.len);
+    if (cli.timings)
+    {
+        timings_enable();
+    }
 
-    struct file_pos pos = {0};
+    if (cli.jobs < 0)
+    {
+        klog(LL_ERROR, "Invalid job count: %lld", (long long)cli.jobs);
+        err = ERR_ARGS;
+        goto done;
+    }
 
-    size_t token_index = (size_t)(ptr - text.ptr);
+    if (cli.debounce < 0)
+    {
+        klog(LL_ERROR, "Invalid debounce: %lld", (long long)cli.debounce);
+        err = ERR_ARGS;
+        goto done;
+    }
 
-    for (size_t i = 0; i < token_index; ++i)
+    if (cli.trace_path)
     {
-        if (text.ptr[i] == '\n')
-        {
-            ++pos.line;
-            pos.column = 0;
-        }
-        else
+        err = trace_open(cli.trace_path);
+        if (err)
         {
-            ++pos.column;
+            goto done;
         }
     }
 
-    return pos;
-}
-
-prexy enum parser_state {
-    PS_LINE_START,
-    PS_PATTERN,
-    PS_PATTERN_DELIM,
-    PS_COMMAND,
-};
-static prexy_impl(parser_state, to_cstr);
-
-struct fnmar_parser
-{
-    enum parser_state state;
-    struct token token;
-    struct str tail;
-    struct str full_text;
-    bool unexpected_token;
-    bool is_done;
-};
-
-static void fnmar_parser_start( //
-    struct fnmar_parser *const parser,
-    struct str const text
-)
-{
-    *parser = (struct fnmar_parser){
-        .full_text = text,
-        .tail = str_trim_whitespace(text),
-    };
-}
-
-static void fnmar_parser_next(struct fnmar_parser *const parser)
-{
-    if (!parser->is_done)
+    // Walker threads and long-running modes should not wait on stderr
+    if ((cli.recursive || cli.watch || cli.serve) && !log_async_start())
     {
-        switch (parser->state)
-        {
-        case PS_LINE_START:
-            parser->token = parse_line_start(parser->tail, &parser->tail);
-            break;
-
-        case PS_PATTERN:
-            parser->token = parse_pattern(parser->tail, &parser->tail);
-            break;
-
-        case PS_PATTERN_DELIM:
-            parser->token = parse_pattern_delim(parser->tail, &parser->tail);
-            break;
+        klog(LL_WARN, "Could not start the log thread, logging directly");
+    }
 
-        case PS_COMMAND:
-            parser->token = parse_command(parser->tail, &parser->tail);
-            break;
-        }
+    if (cli.serve && !cli.socket_path)
+    {
+        klog(LL_ERROR, "--serve requires --socket");
+        err = ERR_ARGS;
+        goto done;
+    }
 
-        klog(
-            LL_DEBUG,
-            "%-19s %-15s %.*s",
-            parser_state_to_cstr(parser->state),
-            token_kind_to_cstr(parser->token.kind),
-            str_format_args(parser->token.str)
+    // Clients only forward filenames given on the command line
+    if (cli.socket_path && !cli.serve && !cli.recursive && !cli.watch &&
+        !cli.read_stdin && !cli.null_delim)
+    {
+        bool served;
+        err = serve_request(
+            cli.socket_path,
+            cli.filename.ptr,
+            cli.filename.len,
+            &served
         );
-
-        switch (parser->state)
+        if (err || served)
         {
-        case PS_LINE_START:
-            switch (parser->token.kind)
-            {
-            case TOK_NONE:
-                parser->state = PS_PATTERN;
-                break;
-            case TOK_COMMENT:
-            case TOK_EOF:
-                // do nothing
-                break;
-            case TOK_PATTERN:
-            case TOK_SEMI:
-            case TOK_COLON:
-            case TOK_CMD:
-                parser->unexpected_token = true;
-                break;
-            }
-            break;
-
-        case PS_PATTERN:
-            switch (parser->token.kind)
-            {
-            case TOK_PATTERN:
-                parser->state = PS_PATTERN_DELIM;
-                break;
-            case TOK_COMMENT:
-            case TOK_NONE:
-            case TOK_SEMI:
-            case TOK_COLON:
-            case TOK_CMD:
-            case TOK_EOF:
-                parser->unexpected_token = true;
-                break;
-            }
-            break;
-
-        case PS_PATTERN_DELIM:
-            switch (parser->token.kind)
-            {
-            case TOK_NONE:
-                parser->state = PS_PATTERN;
-                break;
-            case TOK_SEMI:
-                // do nothing
-                break;
-            case TOK_COLON:
-                parser->state = PS_COMMAND;
-                break;
-            case TOK_COMMENT:
-            case TOK_PATTERN:
-            case TOK_CMD:
-            case TOK_EOF:
-                parser->unexpected_token = true;
-                break;
-            }
-            break;
-
-        case PS_COMMAND:
-            switch (parser->token.kind)
-            {
-            case TOK_CMD:
-                parser->state = PS_LINE_START;
-                break;
-            case TOK_NONE:
-            case TOK_COMMENT:
-            case TOK_PATTERN:
-            case TOK_SEMI:
-            case TOK_COLON:
-            case TOK_EOF:
-                parser->unexpected_token = true;
-                break;
-            }
-            break;
+            goto done;
         }
-
-        parser->is_done =
-            parser->token.kind == TOK_EOF || parser->unexpected_token;
     }
 
-    if (parser->unexpected_token)
+    if (cli.serve && cli.stamps_path)
     {
-        if (parser->token.kind == TOK_EOF)
+        err = serve_absolute_path(cli.stamps_path, &stamps_path);
+        if (err)
         {
-            klog(LL_ERROR, "Unexpected end of file");
+            goto done;
         }
-        else
+        cli.stamps_path = stamps_path.ptr;
+    }
+    if (cli.serve && cli.output_cache_dir)
+    {
+        err = serve_absolute_path(cli.output_cache_dir, &output_cache_dir);
+        if (err)
         {
-            struct file_pos pos =
-                find_file_pos(parser->full_text, parser->tail.ptr);
-            klog(
-                LL_ERROR,
-                "Unexpected token at line %u col %u: '%.*s'",
-                pos.line + 1,
-                pos.column + 1,
-                str_format_args(parser->token.str)
-            );
+            goto done;
         }
+        cli.output_cache_dir = output_cache_dir.ptr;
     }
-}
 
-static enum error format_and_run( //
-    struct str const cmd_pattern,
-    char const *const filename
-)
-{
-    enum error err = OK;
-
-    // Format: Replace "%" with filename
-
-    struct cstrbuf cmd = {0};
-
-    struct str head = {0};
-    struct str tail = cmd_pattern;
-
-    bool is_split;
-
-    do
+    struct stamp_db stamps = {.fd = -1};
+    if (cli.stamps_path)
     {
-        is_split = str_split_delims(tail, "%", &head, &tail);
-
-        if (!cstrbuf_extend_str(&cmd, head))
+        err = stamp_db_open(&stamps, cli.stamps_path);
+        if (err)
         {
-            err = out_of_memory();
             goto done;
         }
+    }
 
-        if (is_split)
+    struct output_cache output_cache;
+    if (cli.output_cache_dir)
+    {
+        err = output_cache_open(&output_cache, cli.output_cache_dir);
+        if (err)
         {
-            if (!cstrbuf_extend_cstr(&cmd, filename))
-            {
-                err = out_of_memory();
-                goto done;
-            }
+            goto close_stamps;
         }
-    } while (is_split);
-
-    // Run
+    }
 
-    klog(LL_INFO, "Running: %s", cmd.ptr);
-    int exitcode = system(cmd.ptr);
+    struct dispatch_opts const dispatch_opts = {
+        .group = cli.group,
+        .jobs = cli.jobs ? (size_t)cli.jobs : job_pool_default_size(),
+        .stamps = cli.stamps_path ? &stamps : NULL,
+        .output_cache = cli.output_cache_dir ? &output_cache : NULL,
+        .usage = cli.timings,
+    };
 
-    if (exitcode != 0)
+    struct config config = {0};
+    err = config_init_from_file(
+        &config,
+        cli.config_filename,
+        (struct config_opts){
+            .cache = cli.cache,
+        }
+    );
+    if (err)
     {
-        klog(LL_WARN, "Command non-zero exit code: %d", exitcode);
+        goto close_stamps;
     }
 
-done:
-    cstrbuf_deinit(&cmd);
-    return err;
-}
-
-static enum error evaluate( //
-    char const *const filename,
-    char const *const config_filename
-)
-{
-    assert(filename);
-    assert(config_filename);
+    if (cli.serve)
+    {
+        err = serve(&config, dispatch_opts, cli.socket_path);
+        goto deinit_config;
+    }
 
-    struct cstrbuf config_str = {0};
-    enum error err = cstrbuf_init_from_file(&config_str, config_filename);
+    struct dispatch dispatch;
+    err = dispatch_init(&dispatch, &config, dispatch_opts);
     if (err)
     {
-        goto done;
+        goto deinit_config;
     }
 
-    struct fnmar_parser parser = {0};
-    fnmar_parser_start(&parser, cstrbuf_to_str(config_str));
-
-    bool found_match = false;
-
-    while (!parser.is_done)
+    for (size_t i = 0; i < cli.filename.len; ++i)
     {
-        fnmar_parser_next(&parser);
-
-        if (!found_match && parser.token.kind == TOK_PATTERN)
-        {
-            char c;
-            char const *pattern = str_into_cstr_unsafe(parser.token.str, &c);
-
-            found_match = 0 == fnmatch(pattern, filename, 0);
-
-            if (found_match)
-            {
-                klog(LL_DEBUG, "'%s' matched pattern '%s'", filename, pattern);
-            }
-            else
-            {
-                klog(
-                    LL_DEBUG,
-                    "'%s' did not match pattern '%s'",
-                    filename,
-                    pattern
-                );
-            }
-
-            str_revert_into_cstr_unsafe(parser.token.str, c);
-        }
-
-        if (found_match && parser.token.kind == TOK_CMD)
-        {
-            err = format_and_run(parser.token.str, filename);
-            goto done;
-        }
+        error_combine(&err, dispatch_file(&dispatch, cli.filename.ptr[i]));
     }
-
-    klog(LL_WARN, "Did not find pattern match for '%s'", filename);
-    err = ERR_NO_MATCHES;
-
-done:
-    cstrbuf_deinit(&config_str);
-    return err;
-}
-
-prexy struct cli
-{
-    char const *filename;
-
-    px_attr(
-        cliopt,
-        .name = "--config",
-        .short_name = 'c',
-        .help = "Config file (default: " DEFAULT_CONFIG_FILENAME ")"
-    );
-    char const *config_filename;
-
-    px_attr(
-        cliopt,
-        .name = "--verbose",
-        .short_name = 'v',
-        .help = "Print debug messages"
-    );
-    bool verbose;
-};
-static prexy_impl_attr(cli, cliopt_from_args, cliopt);
-
-int main(int const argc, char const *const *const argv)
-{
-    enum error err = OK;
-
-    log_setup_from_env();
-
-    struct cli cli = {
-        .config_filename = DEFAULT_CONFIG_FILENAME,
-    };
-
-    struct cliopt_prog const progopts = {
-        .name = "fnmar",
-    };
-
-    if (!cli_from_args(&cli, argc, argv, progopts))
+    if (cli.recursive)
     {
-        err = ERR_ARGS;
-        goto done;
+        error_combine(
+            &err,
+            walk_dispatch(&dispatch, cli.recursive, job_pool_default_size())
+        );
     }
+    if (cli.read_stdin || cli.null_delim)
+    {
+        char const delim = cli.null_delim ? '\0' : '\n';
+        error_combine(&err, dispatch_stdin(&dispatch, delim));
+    }
+    if (cli.watch)
+    {
+        error_combine(
+            &err,
+            watch_dispatch(&dispatch, cli.watch, (u64)cli.debounce)
+        );
+    }
+    error_combine(&err, dispatch_finish(&dispatch));
 
-    if (cli.verbose)
+    if (cli.timings)
     {
-        log_set_level(LL_DEBUG);
+        // Keep queued log messages out of the table
+        log_async_stop();
+        dispatch_print_usage(&dispatch);
     }
 
-    err = evaluate(cli.filename, cli.config_filename);
+    dispatch_deinit(&dispatch);
+
+deinit_config:
+    config_deinit(&config);
+
+close_stamps:
+    stamp_db_close(&stamps);
 
 done:
+    log_async_stop();
+    timings_print();
+    trace_close();
+    cstrbuf_deinit(&output_cache_dir);
+    cstrbuf_deinit(&stamps_path);
+    da_deinit(&cli.filename);
     return (int)err;
 }
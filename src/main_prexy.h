@@ -5,41 +5,9 @@
 
 #include "prexy.h"
 
-// prexy enum token_kind {
-//     TOK_NONE,
-//     TOK_COMMENT,
-//     TOK_PATTERN,
-//     TOK_SEMI,
-//     TOK_COLON,
-//     TOK_CMD,
-//     TOK_EOF,
-// };
-#define token_kind_COUNT 7
-#define token_kind_X(X)                                                        \
-    X(TOK_NONE)                                                                \
-    X(TOK_COMMENT)                                                             \
-    X(TOK_PATTERN)                                                             \
-    X(TOK_SEMI)                                                                \
-    X(TOK_COLON)                                                               \
-    X(TOK_CMD)                                                                 \
-    X(TOK_EOF)
-
-// prexy enum parser_state {
-//     PS_LINE_START,
-//     PS_PATTERN,
-//     PS_PATTERN_DELIM,
-//     PS_COMMAND,
-// };
-#define parser_state_COUNT 4
-#define parser_state_X(X)                                                      \
-    X(PS_LINE_START)                                                           \
-    X(PS_PATTERN)                                                              \
-    X(PS_PATTERN_DELIM)                                                        \
-    X(PS_COMMAND)
-
 // prexy struct cli
 // {
-//     char const *filename;
+//     struct cliopt_strs filename;
 //
 //     px_attr(
 //         cliopt,
@@ -56,14 +24,144 @@
 //         .help = "Print debug messages"
 //     );
 //     bool verbose;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--group",
+//         .short_name = 'g',
+//         .help = "Run each command once with all of its matched files"
+//     );
+//     bool group;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--jobs",
+//         .short_name = 'j',
+//         .argname = "N",
+//         .help = "Max concurrent commands (default: number of CPUs)"
+//     );
+//     i64 jobs;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--cache",
+//         .help = "Reuse a compiled copy of the config file (CONFIG.cache)"
+//     );
+//     bool cache;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--stamps",
+//         .argname = "FILE",
+//         .help = "Skip files unchanged since their command last succeeded"
+//     );
+//     char const *stamps_path;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--output-cache",
+//         .argname = "DIR",
+//         .help = "Reuse what commands left in files with the same contents"
+//     );
+//     char const *output_cache_dir;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--serve",
+//         .sufficient = true,
+//         .help = "Run as a server for clients using --socket"
+//     );
+//     bool serve;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--socket",
+//         .argname = "PATH",
+//         .help = "Unix socket of the server, if one is running"
+//     );
+//     char const *socket_path;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--recursive",
+//         .short_name = 'r',
+//         .argname = "DIR",
+//         .sufficient = true,
+//         .help = "Also run on every matching file under DIR"
+//     );
+//     char const *recursive;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--watch",
+//         .short_name = 'w',
+//         .argname = "DIR",
+//         .sufficient = true,
+//         .help = "Keep running on matching files under DIR as they change"
+//     );
+//     char const *watch;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--debounce",
+//         .argname = "MS",
+//         .help = "Wait for writes to a watched file to stop (default: 100)"
+//     );
+//     i64 debounce;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--timings",
+//         .help = "Print how long each phase and rule took on exit"
+//     );
+//     bool timings;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--trace",
+//         .argname = "FILE",
+//         .help = "Write a Chrome trace of config, matching and commands"
+//     );
+//     char const *trace_path;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--stdin",
+//         .sufficient = true,
+//         .help = "Also read newline-separated filenames from stdin"
+//     );
+//     bool read_stdin;
+//
+//     px_attr(
+//         cliopt,
+//         .name = "--null",
+//         .short_name = '0',
+//         .sufficient = true,
+//         .help = "Read NUL-separated filenames from stdin (implies --stdin)"
+//     );
+//     bool null_delim;
 // };
 #define cli_X(F)                                                               \
-    F(simple, char const *, filename)                                          \
+    F(simple, struct cliopt_strs, filename)                                    \
     F(simple, char const *, config_filename)                                   \
-    F(simple, bool, verbose)
+    F(simple, bool, verbose)                                                   \
+    F(simple, bool, group)                                                     \
+    F(simple, i64, jobs)                                                       \
+    F(simple, bool, cache)                                                     \
+    F(simple, char const *, stamps_path)                                       \
+    F(simple, char const *, output_cache_dir)                                  \
+    F(simple, bool, serve)                                                     \
+    F(simple, char const *, socket_path)                                       \
+    F(simple, char const *, recursive)                                         \
+    F(simple, char const *, watch)                                             \
+    F(simple, i64, debounce)                                                   \
+    F(simple, bool, timings)                                                   \
+    F(simple, char const *, trace_path)                                        \
+    F(simple, bool, read_stdin)                                                \
+    F(simple, bool, null_delim)
 
 #define cli_X_cliopt(F)                                                        \
-    F(simple, char const *, filename)                                          \
+    F(simple, struct cliopt_strs, filename)                                    \
     F(cliopt,                                                                  \
       char const *,                                                            \
       config_filename,                                                         \
@@ -75,12 +173,99 @@
       verbose,                                                                 \
       .name = "--verbose",                                                     \
       .short_name = 'v',                                                       \
-      .help = "Print debug messages")
+      .help = "Print debug messages")                                          \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      group,                                                                   \
+      .name = "--group",                                                       \
+      .short_name = 'g',                                                       \
+      .help = "Run each command once with all of its matched files")           \
+    F(cliopt,                                                                  \
+      i64,                                                                     \
+      jobs,                                                                    \
+      .name = "--jobs",                                                        \
+      .short_name = 'j',                                                       \
+      .argname = "N",                                                          \
+      .help = "Max concurrent commands (default: number of CPUs)")             \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      cache,                                                                   \
+      .name = "--cache",                                                       \
+      .help = "Reuse a compiled copy of the config file (CONFIG.cache)")       \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      stamps_path,                                                             \
+      .name = "--stamps",                                                      \
+      .argname = "FILE",                                                       \
+      .help = "Skip files unchanged since their command last succeeded")       \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      output_cache_dir,                                                        \
+      .name = "--output-cache",                                                \
+      .argname = "DIR",                                                        \
+      .help = "Reuse what commands left in files with the same contents")      \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      serve,                                                                   \
+      .name = "--serve",                                                       \
+      .sufficient = true,                                                      \
+      .help = "Run as a server for clients using --socket")                    \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      socket_path,                                                             \
+      .name = "--socket",                                                      \
+      .argname = "PATH",                                                       \
+      .help = "Unix socket of the server, if one is running")                  \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      recursive,                                                               \
+      .name = "--recursive",                                                   \
+      .short_name = 'r',                                                       \
+      .argname = "DIR",                                                        \
+      .sufficient = true,                                                      \
+      .help = "Also run on every matching file under DIR")                     \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      watch,                                                                   \
+      .name = "--watch",                                                       \
+      .short_name = 'w',                                                       \
+      .argname = "DIR",                                                        \
+      .sufficient = true,                                                      \
+      .help = "Keep running on matching files under DIR as they change")       \
+    F(cliopt,                                                                  \
+      i64,                                                                     \
+      debounce,                                                                \
+      .name = "--debounce",                                                    \
+      .argname = "MS",                                                         \
+      .help = "Wait for writes to a watched file to stop (default: 100)")      \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      timings,                                                                 \
+      .name = "--timings",                                                     \
+      .help = "Print how long each phase and rule took on exit")               \
+    F(cliopt,                                                                  \
+      char const *,                                                            \
+      trace_path,                                                              \
+      .name = "--trace",                                                       \
+      .argname = "FILE",                                                       \
+      .help = "Write a Chrome trace of config, matching and commands")         \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      read_stdin,                                                              \
+      .name = "--stdin",                                                       \
+      .sufficient = true,                                                      \
+      .help = "Also read newline-separated filenames from stdin")              \
+    F(cliopt,                                                                  \
+      bool,                                                                    \
+      null_delim,                                                              \
+      .name = "--null",                                                        \
+      .short_name = '0',                                                       \
+      .sufficient = true,                                                      \
+      .help = "Read NUL-separated filenames from stdin (implies --stdin)")
 
-#define cli_FIELDTYPE_filename char const *
+#define cli_FIELDTYPE_filename struct cliopt_strs
 #define cli_IS_MUT_PTR_filename 0
-#define cli_IS_CONST_PTR_filename 1
-#define cli_PTRTYPE_filename char
+#define cli_IS_CONST_PTR_filename 0
 #define cli_FIELDTYPE_config_filename char const *
 #define cli_IS_MUT_PTR_config_filename 0
 #define cli_IS_CONST_PTR_config_filename 1
@@ -88,5 +273,53 @@
 #define cli_FIELDTYPE_verbose bool
 #define cli_IS_MUT_PTR_verbose 0
 #define cli_IS_CONST_PTR_verbose 0
+#define cli_FIELDTYPE_group bool
+#define cli_IS_MUT_PTR_group 0
+#define cli_IS_CONST_PTR_group 0
+#define cli_FIELDTYPE_jobs i64
+#define cli_IS_MUT_PTR_jobs 0
+#define cli_IS_CONST_PTR_jobs 0
+#define cli_FIELDTYPE_cache bool
+#define cli_IS_MUT_PTR_cache 0
+#define cli_IS_CONST_PTR_cache 0
+#define cli_FIELDTYPE_stamps_path char const *
+#define cli_IS_MUT_PTR_stamps_path 0
+#define cli_IS_CONST_PTR_stamps_path 1
+#define cli_PTRTYPE_stamps_path char
+#define cli_FIELDTYPE_output_cache_dir char const *
+#define cli_IS_MUT_PTR_output_cache_dir 0
+#define cli_IS_CONST_PTR_output_cache_dir 1
+#define cli_PTRTYPE_output_cache_dir char
+#define cli_FIELDTYPE_serve bool
+#define cli_IS_MUT_PTR_serve 0
+#define cli_IS_CONST_PTR_serve 0
+#define cli_FIELDTYPE_socket_path char const *
+#define cli_IS_MUT_PTR_socket_path 0
+#define cli_IS_CONST_PTR_socket_path 1
+#define cli_PTRTYPE_socket_path char
+#define cli_FIELDTYPE_recursive char const *
+#define cli_IS_MUT_PTR_recursive 0
+#define cli_IS_CONST_PTR_recursive 1
+#define cli_PTRTYPE_recursive char
+#define cli_FIELDTYPE_watch char const *
+#define cli_IS_MUT_PTR_watch 0
+#define cli_IS_CONST_PTR_watch 1
+#define cli_PTRTYPE_watch char
+#define cli_FIELDTYPE_debounce i64
+#define cli_IS_MUT_PTR_debounce 0
+#define cli_IS_CONST_PTR_debounce 0
+#define cli_FIELDTYPE_timings bool
+#define cli_IS_MUT_PTR_timings 0
+#define cli_IS_CONST_PTR_timings 0
+#define cli_FIELDTYPE_trace_path char const *
+#define cli_IS_MUT_PTR_trace_path 0
+#define cli_IS_CONST_PTR_trace_path 1
+#define cli_PTRTYPE_trace_path char
+#define cli_FIELDTYPE_read_stdin bool
+#define cli_IS_MUT_PTR_read_stdin 0
+#define cli_IS_CONST_PTR_read_stdin 0
+#define cli_FIELDTYPE_null_delim bool
+#define cli_IS_MUT_PTR_null_delim 0
+#define cli_IS_CONST_PTR_null_delim 0
 
 #endif
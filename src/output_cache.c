@@ -0,0 +1,486 @@
+#include "output_cache.h"
+#include "error.h"
+#include "krs_arena.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_types.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#define OUTPUT_CACHE_BUF_SIZE (16 * 1024)
+
+// Suffix of the entry recording that the command left its input unchanged
+#define OUTPUT_CACHE_SAME_SUFFIX ".same"
+
+// Entries are at DIR/XX/CONTENT-CMD-SIZE, where XX is the first byte of
+// CONTENT, to keep directories small
+static bool output_cache_entry_path(
+    struct output_cache const *const cache,
+    struct output_key const *const key,
+    char const *const suffix,
+    struct cstrbuf *const path,
+    size_t *const subdir_len
+)
+{
+    char subdir[8];
+    snprintf(subdir, sizeof(subdir), "/%02x", key->content_digest[0]);
+
+    char name[128] = "/";
+    for (size_t i = 0; i < HASH_SHA256_SIZE; ++i)
+    {
+        snprintf(&name[1 + i * 2], 3, "%02x", key->content_digest[i]);
+    }
+    snprintf(
+        &name[1 + HASH_SHA256_SIZE * 2],
+        sizeof(name) - 1 - HASH_SHA256_SIZE * 2,
+        "-%016llx-%llu",
+        (unsigned long long)key->cmd_hash,
+        (unsigned long long)key->size
+    );
+
+    cstrbuf_clear(path);
+
+    bool const ok = cstrbuf_extend_cstr(path, cache->dir) &&
+                    cstrbuf_extend_cstr(path, subdir);
+    *subdir_len = path->len;
+
+    return ok && cstrbuf_extend_cstr(path, name) &&
+           cstrbuf_extend_cstr(path, suffix);
+}
+
+// Copy the rest of `src` to `dst`, sharing blocks if the filesystem can
+static bool output_cache_copy(int const src, int const dst)
+{
+#ifdef FICLONE
+    if (0 == ioctl(dst, FICLONE, src))
+    {
+        return true;
+    }
+#endif
+
+#ifdef SYS_copy_file_range
+    // The libc wrapper needs _GNU_SOURCE. On failure the offsets are where
+    // the copy stopped, so the loop below picks up from there.
+    for (;;)
+    {
+        long const n = syscall(
+            SYS_copy_file_range,
+            src,
+            NULL,
+            dst,
+            NULL,
+            (size_t)1 << 30,
+            0u
+        );
+        if (n == 0)
+        {
+            return true;
+        }
+        if (n < 0)
+        {
+            break;
+        }
+    }
+#endif
+
+    char buf[OUTPUT_CACHE_BUF_SIZE];
+
+    for (;;)
+    {
+        ssize_t const n = read(src, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return n == 0;
+        }
+
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t const w = write(dst, &buf[done], (size_t)(n - done));
+            if (w < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (w <= 0)
+            {
+                return false;
+            }
+            done += w;
+        }
+    }
+}
+
+enum error output_cache_open(
+    struct output_cache *const cache,
+    char const *const dir
+)
+{
+    assert(dir);
+
+    enum error err = OK;
+
+    *cache = (struct output_cache){
+        .dir = dir,
+    };
+
+    if (mkdir(dir, 0755) && errno != EEXIST)
+    {
+        perror(dir);
+        err = ERR_FILESYSTEM;
+    }
+
+    return err;
+}
+
+void output_key_from_file(
+    struct output_key *const key,
+    char const *const filename,
+    u64 const cmd_hash
+)
+{
+    *key = (struct output_key){
+        .cmd_hash = cmd_hash,
+    };
+
+    int const fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    char buf[OUTPUT_CACHE_BUF_SIZE];
+    struct hash_sha256 hash;
+    hash_sha256_init(&hash);
+
+    for (;;)
+    {
+        ssize_t const n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            key->valid = n == 0;
+            break;
+        }
+
+        hash_sha256_update(&hash, buf, (size_t)n);
+        key->size += (u64)n;
+    }
+
+    hash_sha256_final(&hash, key->content_digest);
+
+    close(fd);
+}
+
+// Check if `filename` can be replaced by a new file without losing what
+// other links to it would see
+static bool output_cache_replaceable(
+    char const *const filename,
+    struct stat *const st
+)
+{
+    return 0 == lstat(filename, st) && S_ISREG(st->st_mode) &&
+           st->st_nlink == 1;
+}
+
+enum error output_cache_apply(
+    struct output_cache const *const cache,
+    struct output_key const *const key,
+    char const *const filename,
+    struct arena *const scratch,
+    bool *const hit
+)
+{
+    assert(key->valid);
+
+    enum error err = OK;
+    struct cstrbuf path = {.arena = scratch};
+    struct cstrbuf tmp_path = {.arena = scratch};
+    int src = -1;
+    int dst = -1;
+
+    *hit = false;
+
+    size_t subdir_len;
+    if (!output_cache_entry_path(cache, key, "", &path, &subdir_len))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    src = open(path.ptr, O_RDONLY | O_CLOEXEC);
+    if (src < 0)
+    {
+        // The file may already be in the form the command leaves it
+        if (!cstrbuf_extend_cstr(&path, OUTPUT_CACHE_SAME_SUFFIX))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+
+        *hit = 0 == access(path.ptr, F_OK);
+        goto done;
+    }
+
+    // Symlinks and hard links are left for the command to write through
+    struct stat target;
+    struct stat entry;
+    if (!output_cache_replaceable(filename, &target) || fstat(src, &entry))
+    {
+        goto done;
+    }
+
+    // Copy next to the file, then rename it into place, so that a failed
+    // copy never leaves the file cut short
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.fnmar.tmp", (long)getpid());
+
+    if (!cstrbuf_extend_cstr(&tmp_path, filename) ||
+        !cstrbuf_extend_cstr(&tmp_path, suffix))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    dst = open(
+        tmp_path.ptr,
+        O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+        S_IRUSR | S_IWUSR
+    );
+    if (dst < 0)
+    {
+        // e.g. a read-only directory, where the command may still work
+        klog(LL_DEBUG, "Cannot create '%s', not using cache", tmp_path.ptr);
+        goto done;
+    }
+
+    struct stat copied;
+    if (!output_cache_copy(src, dst) || fstat(dst, &copied) ||
+        copied.st_size != entry.st_size)
+    {
+        perror(filename);
+        err = ERR_FILESYSTEM;
+        goto discard;
+    }
+
+    // Without the same owner, the command runs as if there was no entry
+    if ((copied.st_uid != target.st_uid || copied.st_gid != target.st_gid) &&
+        fchown(dst, target.st_uid, target.st_gid))
+    {
+        klog(LL_DEBUG, "Cannot keep owner of '%s', not using cache", filename);
+        goto discard;
+    }
+
+    if (fchmod(dst, target.st_mode & 07777) ||
+        rename(tmp_path.ptr, filename))
+    {
+        perror(filename);
+        err = ERR_FILESYSTEM;
+        goto discard;
+    }
+
+    *hit = true;
+    goto done;
+
+discard:
+    unlink(tmp_path.ptr);
+
+done:
+    if (dst >= 0)
+    {
+        close(dst);
+    }
+    if (src >= 0)
+    {
+        close(src);
+    }
+    cstrbuf_deinit(&tmp_path);
+    cstrbuf_deinit(&path);
+    return err;
+}
+
+enum error output_cache_store(
+    struct output_cache const *const cache,
+    struct output_key const *const key,
+    char const *const filename,
+    struct arena *const scratch
+)
+{
+    assert(key->valid);
+
+    enum error err = OK;
+    struct cstrbuf path = {.arena = scratch};
+    struct cstrbuf tmp_path = {.arena = scratch};
+    int src = -1;
+    int dst = -1;
+
+    struct output_key out;
+    output_key_from_file(&out, filename, key->cmd_hash);
+    if (!out.valid)
+    {
+        // Removed by the command, nothing to cache
+        goto done;
+    }
+
+    bool const same = out.size == key->size &&
+                      0 == memcmp(
+                               out.content_digest,
+                               key->content_digest,
+                               sizeof(key->content_digest)
+                           );
+
+    size_t subdir_len;
+    if (!output_cache_entry_path(
+            cache,
+            key,
+            same ? OUTPUT_CACHE_SAME_SUFFIX : "",
+            &path,
+            &subdir_len
+        ))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    path.ptr[subdir_len] = '\0';
+    if (mkdir(path.ptr, 0755) && errno != EEXIST)
+    {
+        perror(path.ptr);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+    path.ptr[subdir_len] = '/';
+
+    if (same)
+    {
+        dst = open(path.ptr, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (dst < 0)
+        {
+            perror(path.ptr);
+            err = ERR_FILESYSTEM;
+        }
+        goto done;
+    }
+
+    // Write to a private file, then rename it into place so that readers
+    // never see a partial entry
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+
+    if (!cstrbuf_extend_cstr(&tmp_path, path.ptr) ||
+        !cstrbuf_extend_cstr(&tmp_path, suffix))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    src = open(filename, O_RDONLY | O_CLOEXEC);
+    dst = open(tmp_path.ptr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (src < 0 || dst < 0 || !output_cache_copy(src, dst) ||
+        rename(tmp_path.ptr, path.ptr))
+    {
+        perror(path.ptr);
+        unlink(tmp_path.ptr);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    klog(LL_DEBUG, "Cached output of '%s'", filename);
+
+done:
+    if (dst >= 0)
+    {
+        close(dst);
+    }
+    if (src >= 0)
+    {
+        close(src);
+    }
+    cstrbuf_deinit(&tmp_path);
+    cstrbuf_deinit(&path);
+    return err;
+}
+
+#else
+
+enum error output_cache_open(
+    struct output_cache *const cache,
+    char const *const dir
+)
+{
+    *cache = (struct output_cache){
+        .dir = dir,
+    };
+
+    klog(LL_ERROR, "--output-cache is not supported on Windows");
+    return ERR_ARGS;
+}
+
+void output_key_from_file(
+    struct output_key *const key,
+    char const *const filename,
+    u64 const cmd_hash
+)
+{
+    (void)filename;
+
+    *key = (struct output_key){
+        .cmd_hash = cmd_hash,
+    };
+}
+
+enum error output_cache_apply(
+    struct output_cache const *const cache,
+    struct output_key const *const key,
+    char const *const filename,
+    struct arena *const scratch,
+    bool *const hit
+)
+{
+    (void)cache;
+    (void)key;
+    (void)filename;
+    (void)scratch;
+
+    *hit = false;
+    return OK;
+}
+
+enum error output_cache_store(
+    struct output_cache const *const cache,
+    struct output_key const *const key,
+    char const *const filename,
+    struct arena *const scratch
+)
+{
+    (void)cache;
+    (void)key;
+    (void)filename;
+    (void)scratch;
+
+    return OK;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef OUTPUT_CACHE_H_
+#define OUTPUT_CACHE_H_
+
+#include "error.h"
+#include "krs_arena.h"
+#include "krs_cc_ext.h"
+#include "krs_hash.h"
+#include "krs_types.h"
+#include "prexy.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Identity of a command's input: a file's contents and the rule's command
+struct output_key
+{
+    // FNV-1a hash of the rule's command template
+    u64 cmd_hash;
+    // SHA-256 of the file contents. Entries replace the file, so a
+    // collision must not be possible in practice.
+    unsigned char content_digest[HASH_SHA256_SIZE];
+    u64 size;
+    // False if the file could not be read
+    bool valid;
+};
+
+prexy struct output_keys
+{
+    struct output_key *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Directory of file contents left by commands, by the input they were run on
+struct output_cache
+{
+    char const *dir;
+};
+
+// Use the cache directory `dir`, creating it if needed. `dir` must outlive
+// `cache`.
+nodiscard enum error output_cache_open(
+    struct output_cache *cache,
+    char const *dir
+);
+
+// Get the key of running a command with hash `cmd_hash` on `filename`
+void output_key_from_file(
+    struct output_key *key,
+    char const *filename,
+    u64 cmd_hash
+);
+
+// Give `filename` the contents cached for `key`, if any, and set `*hit`.
+// The file is replaced by a copy with the same owner and mode, unless it is
+// a symlink or has other hard links. Paths are built in `scratch`.
+nodiscard enum error output_cache_apply(
+    struct output_cache const *cache,
+    struct output_key const *key,
+    char const *filename,
+    struct arena *scratch,
+    bool *hit
+);
+
+// Cache the contents of `filename` as the output for `key`. Paths are built
+// in `scratch`.
+nodiscard enum error output_cache_store(
+    struct output_cache const *cache,
+    struct output_key const *key,
+    char const *filename,
+    struct arena *scratch
+);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef PREXY_CLIENT_OUTPUT_CACHE_H_
+#define PREXY_CLIENT_OUTPUT_CACHE_H_
+
+/* Generated by prexy from: output_cache.h */
+
+#include "prexy.h"
+
+// prexy struct output_keys
+// {
+//     struct output_key *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define output_keys_X(F)                                                       \
+    F(simple, struct output_key *, ptr)                                        \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define output_keys_FIELDTYPE_ptr struct output_key *
+#define output_keys_IS_MUT_PTR_ptr 1
+#define output_keys_IS_CONST_PTR_ptr 0
+#define output_keys_PTRTYPE_ptr struct output_key
+#define output_keys_FIELDTYPE_len size_t
+#define output_keys_IS_MUT_PTR_len 0
+#define output_keys_IS_CONST_PTR_len 0
+#define output_keys_FIELDTYPE_cap size_t
+#define output_keys_IS_MUT_PTR_cap 0
+#define output_keys_IS_CONST_PTR_cap 0
+
+#endif
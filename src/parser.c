@@ -0,0 +1,366 @@
+#include "parser.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_to_cstr.h"
+#include "krs_types.h"
+#include "parser_prexy.h"
+#include "prexy.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+static prexy_impl(token_kind, to_cstr);
+static prexy_impl(parser_state, to_cstr);
+
+static enum token_kind get_delim_kind(char const c)
+{
+    enum token_kind kind;
+
+    switch (c)
+    {
+    case ';':
+        kind = TOK_SEMI;
+        break;
+    case ':':
+        kind = TOK_COLON;
+        break;
+    default:
+        kind = TOK_NONE;
+        break;
+    }
+
+    return kind;
+}
+
+static struct token parse_line_start(
+    struct str input,
+    struct charset const *const line_end,
+    struct str *const tail
+)
+{
+    struct token token = {0};
+
+    input = str_trim_left_whitespace(input);
+
+    if (input.len == 0)
+    {
+        token.kind = TOK_EOF;
+        *tail = input;
+    }
+    else if (input.ptr[0] == '#')
+    {
+        token.kind = TOK_COMMENT;
+        str_split_at_charset(input, line_end, &token.str, tail);
+    }
+    else
+    {
+        token.kind = TOK_NONE;
+        *tail = input;
+    }
+
+    return token;
+}
+
+static struct token parse_pattern_delim( //
+    struct str input,
+    struct str *const tail
+)
+{
+    struct token token = {0};
+
+    input = str_trim_left_whitespace(input);
+
+    if (input.len == 0)
+    {
+        token.kind = TOK_EOF;
+        *tail = input;
+    }
+    else
+    {
+        token.kind = get_delim_kind(input.ptr[0]);
+        if (token.kind)
+        {
+            token.str = (struct str){
+                .ptr = input.ptr,
+                .len = 1,
+            };
+            *tail = (struct str){
+                .ptr = &input.ptr[1],
+                .len = input.len - 1,
+            };
+        }
+        else
+        {
+            *tail = input;
+        }
+    }
+
+    return token;
+}
+
+static struct token parse_pattern(
+    struct str input,
+    struct charset const *const pattern_end,
+    struct str *const tail
+)
+{
+    struct token token = {0};
+
+    input = str_trim_left_whitespace(input);
+
+    if (input.len == 0)
+    {
+        token.kind = TOK_EOF;
+        *tail = input;
+    }
+    else
+    {
+        str_split_at_charset(input, pattern_end, &token.str, tail);
+        token.str = str_trim_whitespace(token.str);
+        if (token.str.len > 0)
+        {
+            token.kind = TOK_PATTERN;
+        }
+        else
+        {
+            token = parse_pattern_delim(input, tail);
+        }
+    }
+
+    return token;
+}
+
+static struct token parse_command(
+    struct str input,
+    struct charset const *const line_end,
+    struct str *const tail
+)
+{
+    struct token token = {0};
+
+    input = str_trim_left_char(input, ' ');
+
+    if (input.len == 0)
+    {
+        token.kind = TOK_EOF;
+        *tail = input;
+    }
+    else
+    {
+        str_split_at_charset(input, line_end, &token.str, tail);
+        token.str = str_trim_whitespace(token.str);
+        if (token.str.len > 0)
+        {
+            token.kind = TOK_CMD;
+        }
+        else
+        {
+            token.kind = TOK_NONE;
+        }
+    }
+
+    return token;
+}
+struct file_pos
+{
+    // Zero-indexed line number
+    u32 line;
+    // Zero-indexed column number
+    u32 column;
+};
+
+static struct file_pos find_file_pos( //
+    struct str const text,
+    char const *const ptr
+)
+{
+    assert(ptr != NULL);
+    assert(text.ptr <= ptr);
+    assert((size_t)(ptr - text.ptr) < text.len);
+
+    struct file_pos pos = {0};
+
+    size_t token_index = (size_t)(ptr - text.ptr);
+
+    for (size_t i = 0; i < token_index; ++i)
+    {
+        if (text.ptr[i] == '\n')
+        {
+            ++pos.line;
+            pos.column = 0;
+        }
+        else
+        {
+            ++pos.column;
+        }
+    }
+
+    return pos;
+}
+// Build the set of bytes that end a token. NUL ends every token, as it did
+// when tokens were split with strchr().
+static struct charset token_end(char const *const delims)
+{
+    struct charset set = charset_from_cstr(delims);
+    charset_add(&set, '\0');
+    return set;
+}
+
+void fnmar_parser_start( //
+    struct fnmar_parser *const parser,
+    struct str const text
+)
+{
+    *parser = (struct fnmar_parser){
+        .full_text = text,
+        .tail = str_trim_whitespace(text),
+        .line_end = token_end("\r\n"),
+        .pattern_end = token_end(";:\r\n"),
+    };
+}
+
+void fnmar_parser_next(struct fnmar_parser *const parser)
+{
+    if (!parser->is_done)
+    {
+        switch (parser->state)
+        {
+        case PS_LINE_START:
+            parser->token = parse_line_start(
+                parser->tail,
+                &parser->line_end,
+                &parser->tail
+            );
+            break;
+
+        case PS_PATTERN:
+            parser->token = parse_pattern(
+                parser->tail,
+                &parser->pattern_end,
+                &parser->tail
+            );
+            break;
+
+        case PS_PATTERN_DELIM:
+            parser->token = parse_pattern_delim(parser->tail, &parser->tail);
+            break;
+
+        case PS_COMMAND:
+            parser->token = parse_command(
+                parser->tail,
+                &parser->line_end,
+                &parser->tail
+            );
+            break;
+        }
+
+        klog(
+            LL_DEBUG,
+            "%-19s %-15s %.*s",
+            parser_state_to_cstr(parser->state),
+            token_kind_to_cstr(parser->token.kind),
+            str_format_args(parser->token.str)
+        );
+
+        switch (parser->state)
+        {
+        case PS_LINE_START:
+            switch (parser->token.kind)
+            {
+            case TOK_NONE:
+                parser->state = PS_PATTERN;
+                break;
+            case TOK_COMMENT:
+            case TOK_EOF:
+                // do nothing
+                break;
+            case TOK_PATTERN:
+            case TOK_SEMI:
+            case TOK_COLON:
+            case TOK_CMD:
+                parser->unexpected_token = true;
+                break;
+            }
+            break;
+
+        case PS_PATTERN:
+            switch (parser->token.kind)
+            {
+            case TOK_PATTERN:
+                parser->state = PS_PATTERN_DELIM;
+                break;
+            case TOK_COMMENT:
+            case TOK_NONE:
+            case TOK_SEMI:
+            case TOK_COLON:
+            case TOK_CMD:
+            case TOK_EOF:
+                parser->unexpected_token = true;
+                break;
+            }
+            break;
+
+        case PS_PATTERN_DELIM:
+            switch (parser->token.kind)
+            {
+            case TOK_NONE:
+                parser->state = PS_PATTERN;
+                break;
+            case TOK_SEMI:
+                // do nothing
+                break;
+            case TOK_COLON:
+                parser->state = PS_COMMAND;
+                break;
+            case TOK_COMMENT:
+            case TOK_PATTERN:
+            case TOK_CMD:
+            case TOK_EOF:
+                parser->unexpected_token = true;
+                break;
+            }
+            break;
+
+        case PS_COMMAND:
+            switch (parser->token.kind)
+            {
+            case TOK_CMD:
+                parser->state = PS_LINE_START;
+                break;
+            case TOK_NONE:
+            case TOK_COMMENT:
+            case TOK_PATTERN:
+            case TOK_SEMI:
+            case TOK_COLON:
+            case TOK_EOF:
+                parser->unexpected_token = true;
+                break;
+            }
+            break;
+        }
+
+        parser->is_done =
+            parser->token.kind == TOK_EOF || parser->unexpected_token;
+    }
+
+    if (parser->unexpected_token)
+    {
+        if (parser->token.kind == TOK_EOF)
+        {
+            klog(LL_ERROR, "Unexpected end of file");
+        }
+        else
+        {
+            struct file_pos pos =
+                find_file_pos(parser->full_text, parser->tail.ptr);
+            klog(
+                LL_ERROR,
+                "Unexpected token at line %u col %u: '%.*s'",
+                pos.line + 1,
+                pos.column + 1,
+                str_format_args(parser->token.str)
+            );
+        }
+    }
+}
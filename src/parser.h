@@ -0,0 +1,48 @@
+#ifndef PARSER_H_
+#define PARSER_H_
+
+#include "krs_str.h"
+#include "prexy.h"
+#include <stdbool.h>
+
+prexy enum token_kind {
+    TOK_NONE,
+    TOK_COMMENT,
+    TOK_PATTERN,
+    TOK_SEMI,
+    TOK_COLON,
+    TOK_CMD,
+    TOK_EOF,
+};
+
+// Lexer token. `str` points into the parsed text.
+struct token
+{
+    enum token_kind kind;
+    struct str str;
+};
+
+prexy enum parser_state {
+    PS_LINE_START,
+    PS_PATTERN,
+    PS_PATTERN_DELIM,
+    PS_COMMAND,
+};
+
+struct fnmar_parser
+{
+    enum parser_state state;
+    struct token token;
+    struct str tail;
+    struct str full_text;
+    // Bytes that end comments and commands, and bytes that end patterns
+    struct charset line_end;
+    struct charset pattern_end;
+    bool unexpected_token;
+    bool is_done;
+};
+
+void fnmar_parser_start(struct fnmar_parser *parser, struct str text);
+void fnmar_parser_next(struct fnmar_parser *parser);
+
+#endif
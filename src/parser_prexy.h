@@ -0,0 +1,40 @@
+#ifndef PREXY_CLIENT_PARSER_H_
+#define PREXY_CLIENT_PARSER_H_
+
+/* Generated by prexy from: parser.h */
+
+#include "prexy.h"
+
+// prexy enum token_kind {
+//     TOK_NONE,
+//     TOK_COMMENT,
+//     TOK_PATTERN,
+//     TOK_SEMI,
+//     TOK_COLON,
+//     TOK_CMD,
+//     TOK_EOF,
+// };
+#define token_kind_COUNT 7
+#define token_kind_X(X)                                                        \
+    X(TOK_NONE)                                                                \
+    X(TOK_COMMENT)                                                             \
+    X(TOK_PATTERN)                                                             \
+    X(TOK_SEMI)                                                                \
+    X(TOK_COLON)                                                               \
+    X(TOK_CMD)                                                                 \
+    X(TOK_EOF)
+
+// prexy enum parser_state {
+//     PS_LINE_START,
+//     PS_PATTERN,
+//     PS_PATTERN_DELIM,
+//     PS_COMMAND,
+// };
+#define parser_state_COUNT 4
+#define parser_state_X(X)                                                      \
+    X(PS_LINE_START)                                                           \
+    X(PS_PATTERN)                                                              \
+    X(PS_PATTERN_DELIM)                                                        \
+    X(PS_COMMAND)
+
+#endif
@@ -0,0 +1,120 @@
+#include "path_reader.h"
+#include "error.h"
+#include "krs_str.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Read whatever input is available, without waiting for a full buffer
+static long path_reader_fill(struct path_reader *const reader)
+{
+#ifdef _WIN32
+    return _read(reader->fd, reader->buf, sizeof(reader->buf));
+#else
+    return read(reader->fd, reader->buf, sizeof(reader->buf));
+#endif
+}
+
+void path_reader_init( //
+    struct path_reader *const reader,
+    int const fd,
+    char const delim
+)
+{
+    reader->fd = fd;
+    reader->delim = delim;
+    reader->eof = false;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->path = (struct cstrbuf){0};
+}
+
+void path_reader_deinit(struct path_reader *const reader)
+{
+    cstrbuf_deinit(&reader->path);
+}
+
+enum error path_reader_next(
+    struct path_reader *const reader,
+    char const **const path
+)
+{
+    enum error err = OK;
+
+    *path = NULL;
+    cstrbuf_clear(&reader->path);
+
+    for (;;)
+    {
+        if (reader->pos == reader->len)
+        {
+            if (reader->eof)
+            {
+                // Last path may be missing its delimiter
+                break;
+            }
+
+            long const n = path_reader_fill(reader);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                perror("stdin");
+                err = ERR_FILESYSTEM;
+                goto done;
+            }
+
+            reader->eof = n == 0;
+            reader->pos = 0;
+            reader->len = (size_t)n;
+            continue;
+        }
+
+        char const *const start = &reader->buf[reader->pos];
+        size_t const avail = reader->len - reader->pos;
+        char const *const end = memchr(start, reader->delim, avail);
+        size_t const n = end ? (size_t)(end - start) : avail;
+
+        struct sv const chunk = {
+            .ptr = start,
+            .len = n,
+        };
+
+        if (!cstrbuf_extend_sv(&reader->path, chunk))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+        reader->pos += n;
+
+        if (end)
+        {
+            ++reader->pos;
+
+            if (reader->path.len > 0)
+            {
+                break;
+            }
+        }
+    }
+
+    if (reader->path.len > 0)
+    {
+        *path = reader->path.ptr;
+    }
+
+done:
+    return err;
+}
@@ -0,0 +1,37 @@
+#ifndef PATH_READER_H_
+#define PATH_READER_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PATH_READER_BUF_SIZE 16384
+
+// Splits a stream of delimiter-separated paths. Memory use is bounded by
+// the buffer and the longest path, however long the stream is.
+struct path_reader
+{
+    int fd;
+    char delim;
+    bool eof;
+    // Unconsumed input is `buf[pos..len]`
+    size_t pos;
+    size_t len;
+    char buf[PATH_READER_BUF_SIZE];
+    // Current path
+    struct cstrbuf path;
+};
+
+void path_reader_init(struct path_reader *reader, int fd, char delim);
+void path_reader_deinit(struct path_reader *reader);
+
+// Read the next non-empty path. Sets `*path` to NULL at end of input.
+// `*path` is valid until the next call.
+nodiscard enum error path_reader_next(
+    struct path_reader *reader,
+    char const **path
+);
+
+#endif
@@ -0,0 +1,591 @@
+#include "serve.h"
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+#include "krs_dynamic_array.h"
+#include "krs_log.h"
+#include "krs_str.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Protocol: the client sends its working directory and then each filename,
+// all NUL-terminated, and shuts down its side of the connection. The server
+// replies with one line per event:
+//
+//     match RULE FILENAME     FILENAME matched the rule at index RULE
+//     nomatch FILENAME
+//     exit CODE COMMAND       a command finished
+//     status ERROR            last line, `enum error` of the request
+//
+// Filenames and commands are run relative to the client's directory.
+
+#define SERVE_READ_SIZE 4096
+
+struct serve_reply
+{
+    struct cstrbuf text;
+    bool ok;
+};
+
+// Append "HEAD TAIL\n", or "HEAD\n" if `tail` is NULL
+static void serve_reply_add(
+    struct serve_reply *const reply,
+    char const *const head,
+    char const *const tail
+)
+{
+    reply->ok = reply->ok && cstrbuf_extend_cstr(&reply->text, head) &&
+                (!tail || (cstrbuf_extend_cstr(&reply->text, " ") &&
+                           cstrbuf_extend_cstr(&reply->text, tail))) &&
+                cstrbuf_extend_cstr(&reply->text, "\n");
+}
+
+static void serve_job_done(void *const ctx, char const *cmd, int exitcode)
+{
+    char head[32];
+    snprintf(head, sizeof(head), "exit %d", exitcode);
+    serve_reply_add(ctx, head, cmd);
+}
+
+static bool serve_path_fits(char const *const path)
+{
+    struct sockaddr_un addr;
+    return strlen(path) < sizeof(addr.sun_path);
+}
+
+// Make `fd` not leak into spawned commands
+static int serve_cloexec(int const fd)
+{
+    if (fd >= 0)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+#ifdef MSG_NOSIGNAL
+#define SERVE_SEND_FLAGS MSG_NOSIGNAL
+#else
+// Older macOS SDKs, see `serve_nosigpipe()`
+#define SERVE_SEND_FLAGS 0
+#endif
+
+// Make writes to `fd` fail with EPIPE instead of raising SIGPIPE once the
+// peer is gone, where `send()` has no MSG_NOSIGNAL
+static int serve_nosigpipe(int const fd)
+{
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+    if (fd >= 0)
+    {
+        int const on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return fd;
+}
+
+// Connect to the socket at `path`. Returns -1 on failure, with `errno` set.
+static int serve_connect(char const *const path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+
+    int fd = serve_nosigpipe(serve_cloexec(socket(AF_UNIX, SOCK_STREAM, 0)));
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        int const connect_errno = errno;
+        close(fd);
+        fd = -1;
+        errno = connect_errno;
+    }
+
+    return fd;
+}
+
+// Read until end of stream
+static bool serve_read_all(int const fd, struct cstrbuf *const buf)
+{
+    bool ok = true;
+
+    for (;;)
+    {
+        ok = cstrbuf_reserve(buf, SERVE_READ_SIZE);
+        if (!ok)
+        {
+            break;
+        }
+
+        ssize_t const n = read(fd, &buf->ptr[buf->len], SERVE_READ_SIZE);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            ok = n == 0;
+            break;
+        }
+
+        buf->len += (size_t)n;
+        buf->ptr[buf->len] = '\0';
+    }
+
+    return ok;
+}
+
+static bool serve_write_all(int const fd, char const *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t const n = send(fd, data, len, SERVE_SEND_FLAGS);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        data += n;
+        len -= (size_t)n;
+    }
+
+    return true;
+}
+
+// Run the filenames of one request, adding replies to `reply`
+static enum error serve_run_request(
+    struct config const *const config,
+    struct dispatch_opts const opts,
+    struct str const request,
+    struct serve_reply *const reply
+)
+{
+    enum error err = OK;
+
+    // Records are NUL-terminated
+    char const *record = request.ptr;
+    char const *const end = &request.ptr[request.len];
+
+    if (record == end || end[-1] != '\0')
+    {
+        klog(LL_WARN, "Malformed request");
+        err = ERR_ARGS;
+        goto done;
+    }
+
+    if (chdir(record))
+    {
+        perror(record);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+    record += strlen(record) + 1;
+
+    struct dispatch d;
+    err = dispatch_init(&d, config, opts);
+    if (err)
+    {
+        goto done;
+    }
+    d.on_done = serve_job_done;
+    d.on_done_ctx = reply;
+
+    for (; record < end; record += strlen(record) + 1)
+    {
+        struct rule const *const rule =
+            config_match(config, sv_from_cstr(record));
+
+        if (rule)
+        {
+            char head[32];
+            snprintf(
+                head,
+                sizeof(head),
+                "match %lu",
+                (unsigned long)(rule - config->rules.ptr)
+            );
+            serve_reply_add(reply, head, record);
+
+            error_combine(&err, dispatch_matched(&d, rule, record));
+        }
+        else
+        {
+            klog(LL_WARN, "Did not find pattern match for '%s'", record);
+            serve_reply_add(reply, "nomatch", record);
+            error_combine(&err, ERR_NO_MATCHES);
+        }
+    }
+
+    error_combine(&err, dispatch_finish(&d));
+    dispatch_deinit(&d);
+
+done:
+    return err;
+}
+
+static void serve_connection(
+    struct config const *const config,
+    struct dispatch_opts const opts,
+    int const conn
+)
+{
+    enum error err = OK;
+
+    struct cstrbuf request = {0};
+    struct serve_reply reply = {.ok = true};
+
+    if (!serve_read_all(conn, &request))
+    {
+        klog(LL_WARN, "Could not read request");
+        goto done;
+    }
+
+    // Probe by a starting server
+    if (request.len == 0)
+    {
+        goto done;
+    }
+
+    err = serve_run_request(config, opts, cstrbuf_to_str(request), &reply);
+
+    char head[32];
+    snprintf(head, sizeof(head), "status %d", (int)err);
+    serve_reply_add(&reply, head, NULL);
+
+    if (!reply.ok)
+    {
+        // Send at least the status
+        cstrbuf_clear(&reply.text);
+        reply.ok = true;
+        serve_reply_add(&reply, head, NULL);
+    }
+
+    if (!reply.ok ||
+        !serve_write_all(conn, reply.text.ptr, reply.text.len))
+    {
+        klog(LL_WARN, "Could not send reply");
+    }
+
+done:
+    cstrbuf_deinit(&reply.text);
+    cstrbuf_deinit(&request);
+}
+
+// Listen on `path`, replacing a stale socket file left by a dead server
+static enum error serve_listen(char const *const path, int *const out_fd)
+{
+    enum error err = OK;
+
+    int const probe = serve_connect(path);
+    if (probe >= 0)
+    {
+        close(probe);
+        klog(LL_ERROR, "Server already running on '%s'", path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    struct stat st;
+    if (0 == lstat(path, &st) && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, path);
+
+    int const fd = serve_cloexec(socket(AF_UNIX, SOCK_STREAM, 0));
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(fd, SOMAXCONN))
+    {
+        perror(path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    *out_fd = fd;
+
+done:
+    return err;
+}
+
+enum error serve(
+    struct config const *const config,
+    struct dispatch_opts const opts,
+    char const *const path
+)
+{
+    assert(path);
+
+    enum error err = OK;
+
+    if (!serve_path_fits(path))
+    {
+        klog(LL_ERROR, "Socket path too long: %s", path);
+        err = ERR_ARGS;
+        goto done;
+    }
+
+    int fd;
+    err = serve_listen(path, &fd);
+    if (err)
+    {
+        goto done;
+    }
+
+    klog(LL_INFO, "Serving on '%s'", path);
+
+    for (;;)
+    {
+        int const conn =
+            serve_nosigpipe(serve_cloexec(accept(fd, NULL, NULL)));
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            perror("accept");
+            err = ERR_FILESYSTEM;
+            break;
+        }
+
+        serve_connection(config, opts, conn);
+        close(conn);
+    }
+
+    close(fd);
+
+done:
+    return err;
+}
+
+enum error serve_absolute_path(
+    char const *const path,
+    struct cstrbuf *const out
+)
+{
+    assert(path);
+
+    enum error err = OK;
+
+    cstrbuf_clear(out);
+
+    if (path[0] != '/')
+    {
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, sizeof(cwd)))
+        {
+            perror("getcwd");
+            err = ERR_FILESYSTEM;
+            goto done;
+        }
+
+        if (!cstrbuf_extend_cstr(out, cwd) ||
+            !cstrbuf_extend_cstr(out, "/"))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+    if (!cstrbuf_extend_cstr(out, path))
+    {
+        err = out_of_memory();
+    }
+
+done:
+    return err;
+}
+
+// Parse the number at the start of `s`, or -1 if there is none
+static long serve_parse_number(struct sv const s)
+{
+    return s.len > 0 ? strtol(s.ptr, NULL, 10) : -1;
+}
+
+// Report one reply line on the client side
+static void serve_report(struct sv const line, enum error *const status)
+{
+    struct sv kind;
+    struct sv rest;
+    sv_split_delims(line, " ", &kind, &rest);
+
+    if (sv_equal_cstr(kind, "status"))
+    {
+        *status = (enum error)serve_parse_number(rest);
+    }
+    else if (sv_equal_cstr(kind, "nomatch"))
+    {
+        klog(
+            LL_WARN,
+            "Did not find pattern match for '%.*s'",
+            str_format_args(rest)
+        );
+    }
+    else if (sv_equal_cstr(kind, "match"))
+    {
+        klog(LL_DEBUG, "Server matched: %.*s", str_format_args(rest));
+    }
+    else if (sv_equal_cstr(kind, "exit"))
+    {
+        if (serve_parse_number(rest) != 0)
+        {
+            klog(
+                LL_WARN,
+                "Command non-zero exit code: %.*s",
+                str_format_args(rest)
+            );
+        }
+        else
+        {
+            klog(LL_DEBUG, "Command finished: %.*s", str_format_args(rest));
+        }
+    }
+}
+
+enum error serve_request(
+    char const *const path,
+    char const *const *const filenames,
+    size_t const count,
+    bool *const served
+)
+{
+    assert(path);
+
+    enum error err = OK;
+    struct cstrbuf buf = {0};
+
+    *served = false;
+
+    if (!serve_path_fits(path))
+    {
+        klog(LL_ERROR, "Socket path too long: %s", path);
+        err = ERR_ARGS;
+        goto done;
+    }
+
+    int const fd = serve_connect(path);
+    if (fd < 0)
+    {
+        klog(LL_DEBUG, "No server on '%s', running in-process", path);
+        goto done;
+    }
+    *served = true;
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        perror("getcwd");
+        err = ERR_FILESYSTEM;
+        goto close_fd;
+    }
+
+    // Records keep their terminating NUL
+    bool ok = da_extend(&buf, cwd, strlen(cwd) + 1);
+    for (size_t i = 0; ok && i < count; ++i)
+    {
+        ok = da_extend(&buf, filenames[i], strlen(filenames[i]) + 1);
+    }
+    if (!ok)
+    {
+        err = out_of_memory();
+        goto close_fd;
+    }
+
+    // Status is only set by the reply's last line
+    enum error status = ERR_FILESYSTEM;
+
+    if (!serve_write_all(fd, buf.ptr, buf.len) || shutdown(fd, SHUT_WR))
+    {
+        perror(path);
+        err = ERR_FILESYSTEM;
+        goto close_fd;
+    }
+
+    cstrbuf_clear(&buf);
+    if (!serve_read_all(fd, &buf))
+    {
+        perror(path);
+        err = ERR_FILESYSTEM;
+        goto close_fd;
+    }
+
+    struct sv reply = sv_from_str(cstrbuf_to_str(buf));
+    while (reply.len > 0)
+    {
+        struct sv line;
+        sv_split_delims(reply, "\n", &line, &reply);
+        serve_report(line, &status);
+    }
+
+    err = status;
+
+close_fd:
+    close(fd);
+done:
+    cstrbuf_deinit(&buf);
+    return err;
+}
+
+#else
+
+enum error serve(
+    struct config const *const config,
+    struct dispatch_opts const opts,
+    char const *const path
+)
+{
+    (void)config;
+    (void)opts;
+    (void)path;
+
+    klog(LL_ERROR, "--serve is not supported on Windows");
+    return ERR_ARGS;
+}
+
+enum error serve_absolute_path(
+    char const *const path,
+    struct cstrbuf *const out
+)
+{
+    cstrbuf_clear(out);
+    return cstrbuf_extend_cstr(out, path) ? OK : out_of_memory();
+}
+
+enum error serve_request(
+    char const *const path,
+    char const *const *const filenames,
+    size_t const count,
+    bool *const served
+)
+{
+    (void)path;
+    (void)filenames;
+    (void)count;
+
+    *served = false;
+    return OK;
+}
+
+#endif
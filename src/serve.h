@@ -0,0 +1,37 @@
+#ifndef SERVE_H_
+#define SERVE_H_
+
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Run commands for filenames sent by clients to the Unix socket at `path`.
+// Only returns on error.
+nodiscard enum error serve(
+    struct config const *config,
+    struct dispatch_opts opts,
+    char const *path
+);
+
+// Set `out` to `path` made absolute against the current directory. The
+// server changes into each client's directory, so paths it keeps using,
+// like the stamp file and output cache, must be resolved before serving.
+nodiscard enum error serve_absolute_path(
+    char const *path,
+    struct cstrbuf *out
+);
+
+// Send `filenames` to the server at `path` and report its replies. Sets
+// `*served` to false, without error, if no server is listening.
+nodiscard enum error serve_request(
+    char const *path,
+    char const *const *filenames,
+    size_t count,
+    bool *served
+);
+
+#endif
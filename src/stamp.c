@@ -0,0 +1,571 @@
+#include "stamp.h"
+#include "error.h"
+#include "file_stat.h"
+#include "krs_hash.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_types.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STAMP_INITIAL_SLOTS 1024
+#define STAMP_INITIAL_STRINGS (32 * 1024)
+
+// File magic, the last byte is the format version
+static char const stamp_magic[8] = {'F', 'N', 'M', 'A', 'R', 'S', '\0', 1};
+
+// The stamp file is a header, an open-addressed hash table of slots and a
+// region of path bytes, sized by the header. Lookups only touch the pages
+// they probe. Paths are never removed, so both parts only grow.
+struct stamp_header
+{
+    char magic[8];
+    // Power of two, always more than `used`
+    u64 slot_count;
+    u64 used;
+    u64 strings_len;
+    u64 strings_cap;
+};
+
+struct stamp_slot
+{
+    // Zero if the slot is empty
+    u64 path_hash;
+    // Range of the strings region
+    u64 path_offset;
+    u64 path_len;
+    struct stamp stamp;
+};
+
+static struct stamp_header *stamp_db_header(struct stamp_db const *const db)
+{
+    return (void *)db->map;
+}
+
+static struct stamp_slot *stamp_db_slots(struct stamp_db const *const db)
+{
+    return (void *)&db->map[sizeof(struct stamp_header)];
+}
+
+static char *stamp_db_strings(struct stamp_db const *const db)
+{
+    u64 const slot_count = stamp_db_header(db)->slot_count;
+    return (void *)&db->map
+        [sizeof(struct stamp_header) + slot_count * sizeof(struct stamp_slot)];
+}
+
+// Zero marks an empty slot, so it is never a path's hash
+static u64 stamp_path_hash(struct sv const path)
+{
+    u64 const hash = hash_sv(path);
+    return hash ? hash : 1;
+}
+
+// Size of a stamp file with the given capacities, or 0 if too large
+static size_t stamp_file_size(u64 const slot_count, u64 const strings_cap)
+{
+    u64 const max = SIZE_MAX - sizeof(struct stamp_header);
+
+    if (slot_count > max / sizeof(struct stamp_slot) ||
+        strings_cap > max - slot_count * sizeof(struct stamp_slot))
+    {
+        return 0;
+    }
+
+    return (size_t)(sizeof(struct stamp_header) +
+                    slot_count * sizeof(struct stamp_slot) + strings_cap);
+}
+
+static bool stamp_db_valid(struct stamp_db const *const db)
+{
+    struct stamp_header const *const h = stamp_db_header(db);
+
+    return db->map_len >= sizeof(*h) &&
+           0 == memcmp(h->magic, stamp_magic, sizeof(h->magic)) &&
+           h->slot_count > 0 && (h->slot_count & (h->slot_count - 1)) == 0 &&
+           h->used < h->slot_count && h->strings_cap > 0 &&
+           h->strings_len <= h->strings_cap &&
+           stamp_file_size(h->slot_count, h->strings_cap) == db->map_len;
+}
+
+static bool stamp_equal(struct stamp const *const a, struct stamp const *b)
+{
+    return a->size == b->size && a->mtime_sec == b->mtime_sec &&
+           a->mtime_nsec == b->mtime_nsec && a->dev == b->dev &&
+           a->ino == b->ino && a->cmd_hash == b->cmd_hash;
+}
+
+// Find the slot of `path`, or the empty slot where it belongs. Returns
+// NULL if neither is found, which only happens in a corrupt file.
+static struct stamp_slot *stamp_db_find(
+    struct stamp_db const *const db,
+    struct sv const path,
+    u64 const hash
+)
+{
+    struct stamp_header const *const h = stamp_db_header(db);
+    struct stamp_slot *const slots = stamp_db_slots(db);
+    char const *const strings = stamp_db_strings(db);
+    u64 const mask = h->slot_count - 1;
+
+    u64 i = hash & mask;
+    for (u64 probes = 0; probes < h->slot_count; ++probes, i = (i + 1) & mask)
+    {
+        struct stamp_slot *const slot = &slots[i];
+
+        if (slot->path_hash == 0)
+        {
+            return slot;
+        }
+
+        if (slot->path_hash == hash && slot->path_len == path.len &&
+            path.len <= h->strings_len &&
+            slot->path_offset <= h->strings_len - path.len &&
+            0 == memcmp(&strings[slot->path_offset], path.ptr, path.len))
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+static enum error stamp_db_map(struct stamp_db *const db, size_t const len)
+{
+    enum error err = OK;
+
+    void *const p =
+        mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror(db->path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    db->map = p;
+    db->map_len = len;
+
+done:
+    return err;
+}
+
+// Size the file of `db` for the given capacities and map it, empty
+static enum error stamp_db_init(
+    struct stamp_db *const db,
+    u64 const slot_count,
+    u64 const strings_cap
+)
+{
+    enum error err = OK;
+
+    size_t const len = stamp_file_size(slot_count, strings_cap);
+    if (len == 0)
+    {
+        klog(LL_ERROR, "Stamp file '%s' too large", db->path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    // Truncating first zeroes the old contents
+    if (ftruncate(db->fd, 0) || ftruncate(db->fd, (off_t)len))
+    {
+        perror(db->path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    err = stamp_db_map(db, len);
+    if (err)
+    {
+        goto done;
+    }
+
+    struct stamp_header *const h = stamp_db_header(db);
+    *h = (struct stamp_header){
+        .slot_count = slot_count,
+        .strings_cap = strings_cap,
+    };
+    memcpy(h->magic, stamp_magic, sizeof(h->magic));
+
+done:
+    return err;
+}
+
+// Move the stamps to a new file with the given capacities. The new file is
+// renamed over the old one, so a crash leaves one or the other.
+static enum error stamp_db_grow(
+    struct stamp_db *const db,
+    u64 const slot_count,
+    u64 const strings_cap
+)
+{
+    enum error err = OK;
+
+    struct cstrbuf tmp_path = {0};
+    struct stamp_db tmp = {.fd = -1};
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+
+    if (!cstrbuf_extend_cstr(&tmp_path, db->path) ||
+        !cstrbuf_extend_cstr(&tmp_path, suffix))
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    tmp.path = tmp_path.ptr;
+    tmp.fd = open(tmp.path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (tmp.fd < 0)
+    {
+        perror(tmp.path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    err = stamp_db_init(&tmp, slot_count, strings_cap);
+    if (err)
+    {
+        goto done;
+    }
+
+    struct stamp_header const *const old_h = stamp_db_header(db);
+    struct stamp_header *const h = stamp_db_header(&tmp);
+
+    // Paths keep their offsets
+    memcpy(stamp_db_strings(&tmp), stamp_db_strings(db), old_h->strings_len);
+    h->strings_len = old_h->strings_len;
+
+    struct stamp_slot const *const old_slots = stamp_db_slots(db);
+    struct stamp_slot *const slots = stamp_db_slots(&tmp);
+    u64 const mask = slot_count - 1;
+
+    for (u64 i = 0; i < old_h->slot_count; ++i)
+    {
+        if (old_slots[i].path_hash == 0)
+        {
+            continue;
+        }
+
+        if (h->used + 1 >= slot_count)
+        {
+            klog(LL_ERROR, "Stamp file '%s' is corrupt", db->path);
+            err = ERR_FILESYSTEM;
+            goto done;
+        }
+
+        u64 j = old_slots[i].path_hash & mask;
+        while (slots[j].path_hash != 0)
+        {
+            j = (j + 1) & mask;
+        }
+
+        slots[j] = old_slots[i];
+        ++h->used;
+    }
+
+    // Lock the new file before others can open it
+    if (flock(tmp.fd, LOCK_EX | LOCK_NB) || rename(tmp.path, db->path))
+    {
+        perror(db->path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    klog(
+        LL_DEBUG,
+        "Grew stamp file to %llu slots",
+        (unsigned long long)slot_count
+    );
+
+    char const *const path = db->path;
+    stamp_db_close(db);
+    *db = tmp;
+    db->path = path;
+    tmp = (struct stamp_db){.fd = -1};
+
+done:
+    if (tmp.fd >= 0)
+    {
+        unlink(tmp.path);
+        stamp_db_close(&tmp);
+    }
+    cstrbuf_deinit(&tmp_path);
+    return err;
+}
+
+// Make room for one more path of `len` bytes
+static enum error stamp_db_reserve(struct stamp_db *const db, size_t const len)
+{
+    struct stamp_header const *const h = stamp_db_header(db);
+
+    u64 slot_count = h->slot_count;
+    u64 strings_cap = h->strings_cap;
+
+    // Keep the table at most 3/4 full so probe runs stay short
+    while ((h->used + 1) * 4 > slot_count * 3)
+    {
+        slot_count *= 2;
+    }
+    while (strings_cap - h->strings_len < len)
+    {
+        strings_cap *= 2;
+    }
+
+    if (slot_count == h->slot_count && strings_cap == h->strings_cap)
+    {
+        return OK;
+    }
+
+    return stamp_db_grow(db, slot_count, strings_cap);
+}
+
+enum error stamp_db_open(struct stamp_db *const db, char const *const path)
+{
+    assert(path);
+
+    enum error err = OK;
+
+    *db = (struct stamp_db){
+        .path = path,
+        .fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644),
+    };
+
+    if (db->fd < 0)
+    {
+        perror(path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    // Concurrent runs would lose each other's updates
+    if (flock(db->fd, LOCK_EX | LOCK_NB))
+    {
+        if (errno == EWOULDBLOCK)
+        {
+            klog(LL_ERROR, "Stamp file '%s' is in use", path);
+        }
+        else
+        {
+            perror(path);
+        }
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    struct stat st;
+    if (fstat(db->fd, &st))
+    {
+        perror(path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    if (st.st_size > 0)
+    {
+        err = stamp_db_map(db, (size_t)st.st_size);
+        if (err)
+        {
+            goto done;
+        }
+
+        if (stamp_db_valid(db))
+        {
+            klog(
+                LL_DEBUG,
+                "Loaded %llu stamps from '%s'",
+                (unsigned long long)stamp_db_header(db)->used,
+                path
+            );
+            goto done;
+        }
+
+        klog(LL_WARN, "Resetting invalid stamp file '%s'", path);
+        munmap(db->map, db->map_len);
+        db->map = NULL;
+        db->map_len = 0;
+    }
+
+    err = stamp_db_init(db, STAMP_INITIAL_SLOTS, STAMP_INITIAL_STRINGS);
+
+done:
+    if (err)
+    {
+        stamp_db_close(db);
+    }
+    return err;
+}
+
+void stamp_db_close(struct stamp_db *const db)
+{
+    if (db->map)
+    {
+        munmap(db->map, db->map_len);
+    }
+
+    // Also releases the lock
+    if (db->fd >= 0)
+    {
+        close(db->fd);
+    }
+
+    *db = (struct stamp_db){.fd = -1};
+}
+
+bool stamp_from_file(
+    struct stamp *const stamp,
+    char const *const filename,
+    u64 const cmd_hash
+)
+{
+    struct stat st;
+    bool const ok = 0 == stat(filename, &st);
+
+    if (ok)
+    {
+        struct timespec const mtime = file_stat_mtime(&st);
+        *stamp = (struct stamp){
+            .size = (u64)st.st_size,
+            .mtime_sec = (i64)mtime.tv_sec,
+            .mtime_nsec = (i64)mtime.tv_nsec,
+            .dev = (u64)st.st_dev,
+            .ino = (u64)st.st_ino,
+            .cmd_hash = cmd_hash,
+        };
+    }
+
+    return ok;
+}
+
+bool stamp_db_fresh(
+    struct stamp_db const *const db,
+    char const *const filename,
+    struct stamp const *const stamp
+)
+{
+    struct sv const path = sv_from_cstr(filename);
+    struct stamp_slot const *const slot =
+        stamp_db_find(db, path, stamp_path_hash(path));
+
+    return slot && slot->path_hash != 0 && stamp_equal(&slot->stamp, stamp);
+}
+
+enum error stamp_db_put(
+    struct stamp_db *const db,
+    char const *const filename,
+    struct stamp const *const stamp
+)
+{
+    enum error err = OK;
+
+    struct sv const path = sv_from_cstr(filename);
+    u64 const hash = stamp_path_hash(path);
+
+    struct stamp_slot *slot = stamp_db_find(db, path, hash);
+    if (slot && slot->path_hash != 0)
+    {
+        slot->stamp = *stamp;
+        goto done;
+    }
+
+    err = stamp_db_reserve(db, path.len);
+    if (err)
+    {
+        goto done;
+    }
+
+    // Growing moves the table
+    slot = stamp_db_find(db, path, hash);
+    if (!slot)
+    {
+        klog(LL_ERROR, "Stamp file '%s' is corrupt", db->path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    struct stamp_header *const h = stamp_db_header(db);
+    memcpy(&stamp_db_strings(db)[h->strings_len], path.ptr, path.len);
+
+    *slot = (struct stamp_slot){
+        .path_hash = hash,
+        .path_offset = h->strings_len,
+        .path_len = path.len,
+        .stamp = *stamp,
+    };
+
+    h->strings_len += path.len;
+    ++h->used;
+
+done:
+    return err;
+}
+
+#else
+
+enum error stamp_db_open(struct stamp_db *const db, char const *const path)
+{
+    *db = (struct stamp_db){.path = path, .fd = -1};
+
+    klog(LL_ERROR, "--stamps is not supported on Windows");
+    return ERR_ARGS;
+}
+
+void stamp_db_close(struct stamp_db *const db)
+{
+    *db = (struct stamp_db){.fd = -1};
+}
+
+bool stamp_from_file(
+    struct stamp *const stamp,
+    char const *const filename,
+    u64 const cmd_hash
+)
+{
+    (void)stamp;
+    (void)filename;
+    (void)cmd_hash;
+
+    return false;
+}
+
+bool stamp_db_fresh(
+    struct stamp_db const *const db,
+    char const *const filename,
+    struct stamp const *const stamp
+)
+{
+    (void)db;
+    (void)filename;
+    (void)stamp;
+
+    return false;
+}
+
+enum error stamp_db_put(
+    struct stamp_db *const db,
+    char const *const filename,
+    struct stamp const *const stamp
+)
+{
+    (void)db;
+    (void)filename;
+    (void)stamp;
+
+    return OK;
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef STAMP_H_
+#define STAMP_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// State of a file after a rule's command last succeeded on it
+struct stamp
+{
+    u64 size;
+    i64 mtime_sec;
+    i64 mtime_nsec;
+    u64 dev;
+    u64 ino;
+    // FNV-1a hash of the rule's command template
+    u64 cmd_hash;
+};
+
+// Stamps by path, kept in a file that is mapped and updated in place
+struct stamp_db
+{
+    char const *path;
+    int fd;
+    unsigned char *map;
+    size_t map_len;
+};
+
+// Open the stamp file at `path`, creating it if needed. The file is locked
+// until `stamp_db_close()`. `path` must outlive `db`.
+nodiscard enum error stamp_db_open(struct stamp_db *db, char const *path);
+void stamp_db_close(struct stamp_db *db);
+
+// Get the current stamp of `filename`. Returns false if it cannot be read.
+nodiscard bool stamp_from_file(
+    struct stamp *stamp,
+    char const *filename,
+    u64 cmd_hash
+);
+
+// Check if the last stamp recorded for `filename` equals `stamp`
+nodiscard bool stamp_db_fresh(
+    struct stamp_db const *db,
+    char const *filename,
+    struct stamp const *stamp
+);
+
+// Record `stamp` as the last stamp of `filename`
+nodiscard enum error stamp_db_put(
+    struct stamp_db *db,
+    char const *filename,
+    struct stamp const *stamp
+);
+
+#endif
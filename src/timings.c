@@ -0,0 +1,251 @@
+#include "timings.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+// Samples are counted in buckets of 1/8 of a power of two, so percentiles
+// are within 12.5% using fixed memory
+#define TIMING_SUB_BITS 3
+#define TIMING_SUB_COUNT (1u << TIMING_SUB_BITS)
+#define TIMING_BUCKET_COUNT ((64 - TIMING_SUB_BITS + 1) * TIMING_SUB_COUNT)
+
+struct timing_stats
+{
+    atomic_ullong count;
+    atomic_ullong total_ns;
+    atomic_ullong max_ns;
+    atomic_ullong buckets[TIMING_BUCKET_COUNT];
+};
+
+static atomic_bool timings_enabled;
+static struct timing_stats timings[TIMING_PHASE_COUNT];
+
+static char const *timing_phase_to_cstr(enum timing_phase const phase)
+{
+    char const *s;
+
+    switch (phase)
+    {
+    case TIMING_CONFIG_READ:
+        s = "config read";
+        break;
+    case TIMING_CONFIG_COMPILE:
+        s = "config compile";
+        break;
+    case TIMING_MATCH:
+        s = "match";
+        break;
+    case TIMING_SPAWN:
+        s = "spawn";
+        break;
+    case TIMING_WAIT:
+        s = "wait";
+        break;
+    case TIMING_COMMAND:
+        s = "command";
+        break;
+    case TIMING_PHASE_COUNT:
+    default:
+        s = "?";
+        break;
+    }
+
+    return s;
+}
+
+u64 timings_now(void)
+{
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (u64)ts.tv_sec * 1000000000u + (u64)ts.tv_nsec;
+}
+
+static size_t timing_bucket(u64 const ns)
+{
+    size_t bucket;
+
+    if (ns < TIMING_SUB_COUNT)
+    {
+        bucket = (size_t)ns;
+    }
+    else
+    {
+        unsigned const exp = 63u - (unsigned)__builtin_clzll(ns);
+        unsigned const shift = exp - TIMING_SUB_BITS;
+        size_t const sub = (size_t)(ns >> shift) & (TIMING_SUB_COUNT - 1);
+        bucket = (shift + 1) * TIMING_SUB_COUNT + sub;
+    }
+
+    return bucket;
+}
+
+// Get the middle of the range of durations counted in `bucket`
+static u64 timing_bucket_value(size_t const bucket)
+{
+    u64 value;
+
+    if (bucket < TIMING_SUB_COUNT)
+    {
+        value = bucket;
+    }
+    else
+    {
+        unsigned const shift = (unsigned)(bucket / TIMING_SUB_COUNT) - 1;
+        u64 const sub = bucket % TIMING_SUB_COUNT;
+        u64 const low = (TIMING_SUB_COUNT + sub) << shift;
+        value = low + ((u64)1 << shift) / 2;
+    }
+
+    return value;
+}
+
+void timings_enable(void)
+{
+    atomic_store(&timings_enabled, true);
+}
+
+u64 timings_start(void)
+{
+    bool const measuring =
+        atomic_load_explicit(&timings_enabled, memory_order_relaxed) ||
+        trace_enabled();
+    return measuring ? timings_now() : 0;
+}
+
+void timings_record(
+    enum timing_phase const phase,
+    u64 const start,
+    struct sv const detail
+)
+{
+    if (start == 0)
+    {
+        return;
+    }
+
+    u64 const now = timings_now();
+
+    if (phase != TIMING_COMMAND)
+    {
+        trace_span(timing_phase_to_cstr(phase), start, now, detail);
+    }
+
+    if (!atomic_load_explicit(&timings_enabled, memory_order_relaxed))
+    {
+        return;
+    }
+
+    u64 const ns = now > start ? now - start : 0;
+    struct timing_stats *const stats = &timings[phase];
+
+    atomic_fetch_add_explicit(&stats->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->total_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(
+        &stats->buckets[timing_bucket(ns)],
+        1,
+        memory_order_relaxed
+    );
+
+    unsigned long long max = atomic_load(&stats->max_ns);
+    while (ns > max && !atomic_compare_exchange_weak(&stats->max_ns, &max, ns))
+    {
+    }
+}
+
+// Get the duration at or below which `percent` of the samples fall
+static u64 timing_percentile(
+    struct timing_stats const *const stats,
+    unsigned const percent
+)
+{
+    u64 const count = atomic_load(&stats->count);
+    u64 const rank = (count * percent + 99) / 100;
+
+    u64 seen = 0;
+    size_t bucket = 0;
+    for (; bucket < TIMING_BUCKET_COUNT; ++bucket)
+    {
+        seen += atomic_load(&stats->buckets[bucket]);
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+
+    return MIN(timing_bucket_value(bucket), (u64)atomic_load(&stats->max_ns));
+}
+
+// Format `ns` with a unit that keeps it short
+static void timing_format(char *const buf, size_t const size, u64 const ns)
+{
+    if (ns < 1000u)
+    {
+        snprintf(buf, size, "%lluns", (unsigned long long)ns);
+    }
+    else if (ns < 1000000u)
+    {
+        snprintf(buf, size, "%.1fus", (double)ns / 1e3);
+    }
+    else if (ns < 1000000000u)
+    {
+        snprintf(buf, size, "%.1fms", (double)ns / 1e6);
+    }
+    else
+    {
+        snprintf(buf, size, "%.2fs", (double)ns / 1e9);
+    }
+}
+
+void timings_print(void)
+{
+    if (!atomic_load(&timings_enabled))
+    {
+        return;
+    }
+
+    fprintf(
+        stderr,
+        "%-16s %8s %10s %10s %10s %10s\n",
+        "phase",
+        "count",
+        "total",
+        "p50",
+        "p99",
+        "max"
+    );
+
+    for (size_t i = 0; i < TIMING_PHASE_COUNT; ++i)
+    {
+        struct timing_stats const *const stats = &timings[i];
+
+        char total[16];
+        char p50[16];
+        char p99[16];
+        char max[16];
+        timing_format(total, sizeof(total), atomic_load(&stats->total_ns));
+        timing_format(p50, sizeof(p50), timing_percentile(stats, 50));
+        timing_format(p99, sizeof(p99), timing_percentile(stats, 99));
+        timing_format(max, sizeof(max), atomic_load(&stats->max_ns));
+
+        fprintf(
+            stderr,
+            "%-16s %8llu %10s %10s %10s %10s\n",
+            timing_phase_to_cstr((enum timing_phase)i),
+            (unsigned long long)atomic_load(&stats->count),
+            total,
+            p50,
+            p99,
+            max
+        );
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef TIMINGS_H_
+#define TIMINGS_H_
+
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+
+// Phases of a run whose durations are measured with `--timings` and traced
+// with `--trace`
+enum timing_phase
+{
+    // Reading the config file
+    TIMING_CONFIG_READ,
+    // Parsing and indexing the config, or loading its cache
+    TIMING_CONFIG_COMPILE,
+    // Matching one filename against the rules
+    TIMING_MATCH,
+    // Starting one command
+    TIMING_SPAWN,
+    // Blocking until a command finishes, for a free slot or at the end
+    TIMING_WAIT,
+    // One command, from start to finish
+    TIMING_COMMAND,
+    TIMING_PHASE_COUNT,
+};
+
+// Start measuring. Until then, recording does nothing.
+void timings_enable(void);
+
+// Get the monotonic time in nanoseconds
+nodiscard u64 timings_now(void);
+
+// Get the start time of a measurement, or 0 if neither measuring nor tracing
+nodiscard u64 timings_start(void);
+
+// Record the time since `start` as one sample of `phase`, and trace it with
+// `detail` unless it is a command, which the dispatcher traces with more
+// detail. Thread-safe.
+void timings_record(enum timing_phase phase, u64 start, struct sv detail);
+
+// Print the count, total, p50, p99 and max of each phase to stderr
+void timings_print(void);
+
+#endif
@@ -0,0 +1,236 @@
+#include "trace.h"
+#include "error.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "timings.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Tracks of job slots follow the tracks of threads
+#define TRACE_JOB_TRACK 1000
+// Longer details are cut short
+#define TRACE_DETAIL_MAX 512
+#define TRACE_EVENT_SIZE (TRACE_DETAIL_MAX * 6 + 256)
+
+static FILE *trace_file;
+static u64 trace_origin;
+static atomic_uint trace_thread_count;
+static _Thread_local unsigned trace_thread_track;
+static _Thread_local bool trace_thread_named;
+
+// Append `s` to `buf` as JSON string contents, joining NUL-separated parts
+// with spaces
+static size_t trace_escape(
+    char *const buf,
+    size_t const size,
+    struct sv const s
+)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < s.len && i < TRACE_DETAIL_MAX; ++i)
+    {
+        unsigned char const c = (unsigned char)s.ptr[i];
+
+        // Leave room for the longest escape and a NUL
+        if (len + 7 > size)
+        {
+            break;
+        }
+
+        if (c == '\0')
+        {
+            if (i + 1 < s.len)
+            {
+                buf[len++] = ' ';
+            }
+        }
+        else if (c == '"' || c == '\\')
+        {
+            buf[len++] = '\\';
+            buf[len++] = (char)c;
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            // Bytes are not necessarily UTF-8, so keep the JSON valid
+            len += (size_t)snprintf(&buf[len], 7, "\\u%04x", c);
+        }
+        else
+        {
+            buf[len++] = (char)c;
+        }
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+// Write one event, in one call so that threads do not interleave
+static void trace_write(char const *const event, int const len)
+{
+    if (len > 0)
+    {
+        size_t const n = MIN((size_t)len, (size_t)TRACE_EVENT_SIZE - 1);
+        fwrite(event, 1, n, trace_file);
+    }
+}
+
+static void trace_name_track(unsigned const track, char const *const name)
+{
+    char event[TRACE_EVENT_SIZE];
+    int const len = snprintf(
+        event,
+        sizeof(event),
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+        "\"args\":{\"name\":\"%s\"}},\n",
+        track,
+        name
+    );
+    trace_write(event, len);
+}
+
+static unsigned trace_thread(void)
+{
+    if (!trace_thread_named)
+    {
+        trace_thread_track = atomic_fetch_add(&trace_thread_count, 1);
+        trace_thread_named = true;
+
+        char name[32];
+        snprintf(name, sizeof(name), "thread %u", trace_thread_track);
+        trace_name_track(trace_thread_track, name);
+    }
+
+    return trace_thread_track;
+}
+
+// Get microseconds since the trace was opened
+static double trace_us(u64 const ns)
+{
+    return ns > trace_origin ? (double)(ns - trace_origin) / 1e3 : 0.0;
+}
+
+enum error trace_open(char const *const path)
+{
+    enum error err = OK;
+
+    trace_file = fopen(path, "w");
+    if (!trace_file)
+    {
+        perror(path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    trace_origin = timings_now();
+    fputs("[\n", trace_file);
+
+done:
+    return err;
+}
+
+void trace_close(void)
+{
+    if (trace_file)
+    {
+        // Ends the list without a trailing comma
+        fputs(
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"fnmar\"}}\n]\n",
+            trace_file
+        );
+
+        if (fclose(trace_file))
+        {
+            perror("trace");
+        }
+        trace_file = NULL;
+    }
+}
+
+bool trace_enabled(void)
+{
+    return trace_file != NULL;
+}
+
+void trace_span(
+    char const *const name,
+    u64 const start,
+    u64 const end,
+    struct sv const detail
+)
+{
+    if (!trace_file)
+    {
+        return;
+    }
+
+    unsigned const track = trace_thread();
+
+    char escaped[TRACE_DETAIL_MAX * 6 + 1];
+    trace_escape(escaped, sizeof(escaped), detail);
+
+    char event[TRACE_EVENT_SIZE];
+    int const len = snprintf(
+        event,
+        sizeof(event),
+        "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,"
+        "\"tid\":%u,\"args\":{\"detail\":\"%s\"}},\n",
+        name,
+        trace_us(start),
+        trace_us(end) - trace_us(start),
+        track,
+        escaped
+    );
+    trace_write(event, len);
+}
+
+void trace_name_job_tracks(size_t const count)
+{
+    for (size_t i = 0; trace_file && i < count; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "job %lu", (unsigned long)i);
+        trace_name_track(TRACE_JOB_TRACK + (unsigned)i, name);
+    }
+}
+
+void trace_command(
+    size_t const slot,
+    u64 const start,
+    u64 const end,
+    long const pid,
+    size_t const rule,
+    struct sv const files,
+    int const exitcode
+)
+{
+    if (!trace_file)
+    {
+        return;
+    }
+
+    char escaped[TRACE_DETAIL_MAX * 6 + 1];
+    trace_escape(escaped, sizeof(escaped), files);
+
+    char event[TRACE_EVENT_SIZE];
+    int const len = snprintf(
+        event,
+        sizeof(event),
+        "{\"name\":\"rule %lu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+        "\"pid\":1,\"tid\":%u,\"args\":{\"pid\":%ld,\"rule\":%lu,"
+        "\"file\":\"%s\",\"exit\":%d}},\n",
+        (unsigned long)rule,
+        trace_us(start),
+        trace_us(end) - trace_us(start),
+        TRACE_JOB_TRACK + (unsigned)slot,
+        pid,
+        (unsigned long)rule,
+        escaped,
+        exitcode
+    );
+    trace_write(event, len);
+}
@@ -0,0 +1,37 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Write trace events to `path` as Chrome trace-event JSON, which Perfetto
+// and chrome://tracing open. Times are from `timings_now()`.
+nodiscard enum error trace_open(char const *path);
+// Finish the trace file. No other thread may be tracing.
+void trace_close(void);
+
+nodiscard bool trace_enabled(void);
+
+// Record a span of the calling thread. `detail` may be empty.
+void trace_span(char const *name, u64 start, u64 end, struct sv detail);
+
+// Name the tracks of job slots `0..count`
+void trace_name_job_tracks(size_t count);
+
+// Record a command of rule `rule` that ran in job slot `slot` on `files`,
+// which are NUL-separated. `pid` is -1 if unknown.
+void trace_command(
+    size_t slot,
+    u64 start,
+    u64 end,
+    long pid,
+    size_t rule,
+    struct sv files,
+    int exitcode
+);
+
+#endif
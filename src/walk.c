@@ -0,0 +1,319 @@
+#include "walk.h"
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "prexy.h"
+#include "walk_prexy.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define Vec walk_dirs
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+struct walk
+{
+    struct dispatch *dispatch;
+    // Serializes dispatching. Matching needs no lock.
+    pthread_mutex_t dispatch_lock;
+
+    // Guards the fields below
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    // Directories waiting to be read
+    struct walk_dirs dirs;
+    // Number of workers reading a directory
+    size_t busy;
+    // Stop early after a fatal error
+    bool stop;
+    enum error err;
+};
+
+static void walk_error(struct walk *const w, enum error const err)
+{
+    pthread_mutex_lock(&w->lock);
+    error_combine(&w->err, err);
+    if (err == ERR_OUT_OF_MEMORY)
+    {
+        w->stop = true;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Queue directory `path`, taking ownership of it
+static void walk_push(struct walk *const w, char *const path)
+{
+    pthread_mutex_lock(&w->lock);
+    bool const ok = walk_dirs_push(&w->dirs, path);
+    if (ok)
+    {
+        pthread_cond_signal(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (!ok)
+    {
+        free(path);
+        walk_error(w, out_of_memory());
+    }
+}
+
+// Wait for a queued directory. Returns false when the walk is finished.
+static bool walk_pop(struct walk *const w, char **const path)
+{
+    pthread_mutex_lock(&w->lock);
+
+    // Busy workers may still queue more directories
+    while (!w->stop && w->dirs.len == 0 && w->busy > 0)
+    {
+        pthread_cond_wait(&w->cond, &w->lock);
+    }
+
+    bool const found = !w->stop && w->dirs.len > 0;
+    if (found)
+    {
+        *path = w->dirs.ptr[--w->dirs.len];
+        ++w->busy;
+    }
+    else
+    {
+        pthread_cond_broadcast(&w->cond);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+static void walk_pop_done(struct walk *const w)
+{
+    pthread_mutex_lock(&w->lock);
+    if (--w->busy == 0 && w->dirs.len == 0)
+    {
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void walk_file(struct walk *const w, char const *const path)
+{
+    enum error err = OK;
+
+    struct rule const *const rule =
+        config_match(w->dispatch->config, sv_from_cstr(path));
+    if (rule)
+    {
+        pthread_mutex_lock(&w->dispatch_lock);
+        err = dispatch_matched(w->dispatch, rule, path);
+        pthread_mutex_unlock(&w->dispatch_lock);
+    }
+
+    if (err)
+    {
+        walk_error(w, err);
+    }
+}
+
+// Get the type of a directory entry, without following symbolic links
+static unsigned char walk_entry_type(DIR *const dir, struct dirent const *e)
+{
+    unsigned char type = e->d_type;
+
+    if (type == DT_UNKNOWN)
+    {
+        struct stat st;
+        if (0 == fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW))
+        {
+            type = S_ISDIR(st.st_mode)   ? DT_DIR
+                   : S_ISREG(st.st_mode) ? DT_REG
+                                         : DT_UNKNOWN;
+        }
+    }
+
+    return type;
+}
+
+// Read one directory, queueing subdirectories and dispatching files
+static void walk_dir(struct walk *const w, char const *const dir_path)
+{
+    enum error err = OK;
+    struct cstrbuf path = {0};
+    DIR *dir = NULL;
+
+    int const fd = openat(
+        AT_FDCWD,
+        dir_path,
+        O_RDONLY | O_DIRECTORY | O_CLOEXEC
+    );
+    if (fd < 0 || !(dir = fdopendir(fd)))
+    {
+        perror(dir_path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    // "." is left out of paths so they match patterns like "src/*"
+    bool const is_cwd = 0 == strcmp(dir_path, ".");
+    size_t const dir_len = strlen(dir_path);
+    bool const has_slash = dir_len > 0 && dir_path[dir_len - 1] == '/';
+
+    for (struct dirent const *e; (e = readdir(dir));)
+    {
+        if (0 == strcmp(e->d_name, ".") || 0 == strcmp(e->d_name, ".."))
+        {
+            continue;
+        }
+
+        unsigned char const type = walk_entry_type(dir, e);
+        if (type != DT_DIR && type != DT_REG)
+        {
+            continue;
+        }
+
+        cstrbuf_clear(&path);
+        if ((!is_cwd && !cstrbuf_extend_cstr(&path, dir_path)) ||
+            (!is_cwd && !has_slash && !cstrbuf_extend_cstr(&path, "/")) ||
+            !cstrbuf_extend_cstr(&path, e->d_name))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+
+        if (type == DT_DIR)
+        {
+            // Ownership of the buffer moves to the queue
+            walk_push(w, path.ptr);
+            path = (struct cstrbuf){0};
+        }
+        else
+        {
+            walk_file(w, path.ptr);
+        }
+    }
+
+done:
+    if (dir)
+    {
+        closedir(dir);
+    }
+    cstrbuf_deinit(&path);
+    if (err)
+    {
+        walk_error(w, err);
+    }
+}
+
+static void *walk_worker(void *const arg)
+{
+    struct walk *const w = arg;
+
+    char *dir_path;
+    while (walk_pop(w, &dir_path))
+    {
+        walk_dir(w, dir_path);
+        free(dir_path);
+        walk_pop_done(w);
+    }
+
+    return NULL;
+}
+
+enum error walk_dispatch(
+    struct dispatch *const d,
+    char const *const root,
+    size_t const threads
+)
+{
+    assert(root);
+
+    struct walk w = {
+        .dispatch = d,
+    };
+    pthread_mutex_init(&w.dispatch_lock, NULL);
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    pthread_t *const workers =
+        threads > 1 ? calloc(threads - 1, sizeof(workers[0])) : NULL;
+    size_t worker_count = 0;
+
+    struct cstrbuf root_path = {0};
+    if (!cstrbuf_extend_cstr(&root_path, root))
+    {
+        w.err = out_of_memory();
+        goto done;
+    }
+    walk_push(&w, root_path.ptr);
+
+    // Fewer threads is not an error
+    for (; workers && worker_count < threads - 1; ++worker_count)
+    {
+        if (pthread_create(&workers[worker_count], NULL, walk_worker, &w))
+        {
+            klog(LL_DEBUG, "Could not start walker thread");
+            break;
+        }
+    }
+    klog(
+        LL_DEBUG,
+        "Walking '%s' with %lu threads",
+        root,
+        (unsigned long)worker_count + 1
+    );
+
+    walk_worker(&w);
+
+    for (size_t i = 0; i < worker_count; ++i)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+done:
+    // Left over only if the walk stopped early
+    for (size_t i = 0; i < w.dirs.len; ++i)
+    {
+        free(w.dirs.ptr[i]);
+    }
+    walk_dirs_deinit(&w.dirs);
+    free(workers);
+    pthread_cond_destroy(&w.cond);
+    pthread_mutex_destroy(&w.lock);
+    pthread_mutex_destroy(&w.dispatch_lock);
+    return w.err;
+}
+
+#else
+
+enum error walk_dispatch(
+    struct dispatch *const d,
+    char const *const root,
+    size_t const threads
+)
+{
+    (void)d;
+    (void)root;
+    (void)threads;
+
+    klog(LL_ERROR, "--recursive is not supported on Windows");
+    return ERR_ARGS;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef WALK_H_
+#define WALK_H_
+
+#include "dispatch.h"
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "prexy.h"
+#include <stddef.h>
+
+// Directory paths (owned)
+prexy struct walk_dirs
+{
+    char **ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Walk the tree under `root` with up to `threads` threads and dispatch
+// every regular file that matches a rule. Symbolic links are not
+// followed and files matching no rule are skipped.
+nodiscard enum error walk_dispatch(
+    struct dispatch *d,
+    char const *root,
+    size_t threads
+);
+
+#endif
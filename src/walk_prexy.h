@@ -0,0 +1,30 @@
+#ifndef PREXY_CLIENT_WALK_H_
+#define PREXY_CLIENT_WALK_H_
+
+/* Generated by prexy from: walk.h */
+
+#include "prexy.h"
+
+// prexy struct walk_dirs
+// {
+//     char **ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define walk_dirs_X(F)                                                         \
+    F(simple, char **, ptr)                                                    \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define walk_dirs_FIELDTYPE_ptr char **
+#define walk_dirs_IS_MUT_PTR_ptr 1
+#define walk_dirs_IS_CONST_PTR_ptr 0
+#define walk_dirs_PTRTYPE_ptr char *
+#define walk_dirs_FIELDTYPE_len size_t
+#define walk_dirs_IS_MUT_PTR_len 0
+#define walk_dirs_IS_CONST_PTR_len 0
+#define walk_dirs_FIELDTYPE_cap size_t
+#define walk_dirs_IS_MUT_PTR_cap 0
+#define walk_dirs_IS_CONST_PTR_cap 0
+
+#endif
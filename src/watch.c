@@ -0,0 +1,503 @@
+#include "watch.h"
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+#include "krs_log.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+#include "watch_prexy.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define Vec watch_dirs
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+#define Vec watch_events
+#define VEC_IMPLEMENTATION
+#include "krs_vec.inc.h"
+
+// A file is done changing when it is closed after writing or renamed into
+// place. Directory events keep the watch list in sync with the tree.
+#define WATCH_MASK                                                             \
+    (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+#define WATCH_READ_SIZE 4096
+
+struct watch
+{
+    struct dispatch *dispatch;
+    int fd;
+    u64 debounce_ms;
+    struct watch_dirs dirs;
+    // Changed files waiting for the debounce window to pass
+    struct watch_events pending;
+    // Files whose commands are running, to ignore their own writes
+    struct watch_events running;
+};
+
+static u64 watch_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000 + (u64)ts.tv_nsec / 1000000;
+}
+
+// Join a directory and an entry name like the walker does
+static char *watch_join(char const *const dir, char const *const name)
+{
+    struct cstrbuf path = {0};
+
+    // "." is left out of paths so they match patterns like "src/*"
+    bool const is_cwd = 0 == strcmp(dir, ".");
+    size_t const dir_len = strlen(dir);
+    bool const has_slash = dir_len > 0 && dir[dir_len - 1] == '/';
+
+    if ((!is_cwd && !cstrbuf_extend_cstr(&path, dir)) ||
+        (!is_cwd && !has_slash && !cstrbuf_extend_cstr(&path, "/")) ||
+        !cstrbuf_extend_cstr(&path, name))
+    {
+        cstrbuf_deinit(&path);
+        path = (struct cstrbuf){0};
+    }
+
+    return path.ptr;
+}
+
+static struct watch_event *watch_events_find(
+    struct watch_events const *const events,
+    char const *const path
+)
+{
+    for (size_t i = 0; i < events->len; ++i)
+    {
+        if (0 == strcmp(events->ptr[i].path, path))
+        {
+            return &events->ptr[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void watch_events_clear(struct watch_events *const events)
+{
+    for (size_t i = 0; i < events->len; ++i)
+    {
+        free(events->ptr[i].path);
+    }
+    events->len = 0;
+}
+
+// Queue `path` (owned), pushing back its deadline if already queued
+static enum error watch_queue(struct watch *const w, char *const path)
+{
+    enum error err = OK;
+
+    u64 const deadline = watch_now_ms() + w->debounce_ms;
+
+    struct watch_event *const queued = watch_events_find(&w->pending, path);
+    if (queued)
+    {
+        queued->deadline = deadline;
+        free(path);
+    }
+    else
+    {
+        struct watch_event const event = {
+            .path = path,
+            .deadline = deadline,
+        };
+
+        if (!watch_events_push(&w->pending, event))
+        {
+            free(path);
+            err = out_of_memory();
+        }
+    }
+
+    return err;
+}
+
+// Watch `dir_path` (owned) and its subdirectories. Files already in them
+// are queued if `queue_files` is set, since their events were missed.
+static enum error watch_add_tree(
+    struct watch *const w,
+    char *const dir_path,
+    bool const queue_files
+)
+{
+    enum error err = OK;
+    DIR *dir = NULL;
+    bool owned = true;
+
+    int const wd = inotify_add_watch(w->fd, dir_path, WATCH_MASK);
+    if (wd < 0)
+    {
+        perror(dir_path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    while (w->dirs.len <= (size_t)wd)
+    {
+        if (!watch_dirs_push(&w->dirs, NULL))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+    }
+
+    // The same directory may be added twice
+    free(w->dirs.ptr[wd]);
+    w->dirs.ptr[wd] = dir_path;
+    owned = false;
+
+    dir = opendir(dir_path);
+    if (!dir)
+    {
+        perror(dir_path);
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    for (struct dirent const *e; !err && (e = readdir(dir));)
+    {
+        if (0 == strcmp(e->d_name, ".") || 0 == strcmp(e->d_name, ".."))
+        {
+            continue;
+        }
+
+        unsigned char type = e->d_type;
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+            if (0 == fstatat(dirfd(dir), e->d_name, &st, AT_SYMLINK_NOFOLLOW))
+            {
+                type = S_ISDIR(st.st_mode)   ? DT_DIR
+                       : S_ISREG(st.st_mode) ? DT_REG
+                                             : DT_UNKNOWN;
+            }
+        }
+
+        if (type != DT_DIR && !(type == DT_REG && queue_files))
+        {
+            continue;
+        }
+
+        char *const path = watch_join(dir_path, e->d_name);
+        if (!path)
+        {
+            err = out_of_memory();
+        }
+        else if (type == DT_DIR)
+        {
+            err = watch_add_tree(w, path, queue_files);
+        }
+        else
+        {
+            err = watch_queue(w, path);
+        }
+
+        // Missing subdirectories only shrink the watched tree
+        if (err == ERR_FILESYSTEM)
+        {
+            err = OK;
+        }
+    }
+
+done:
+    if (dir)
+    {
+        closedir(dir);
+    }
+    if (owned)
+    {
+        free(dir_path);
+    }
+    return err;
+}
+
+// Handle every queued inotify event. Writes to files in `w->running` are
+// dropped if `suppress` is set.
+static enum error watch_read_events(struct watch *const w, bool const suppress)
+{
+    enum error err = OK;
+
+    _Alignas(struct inotify_event) char buf[WATCH_READ_SIZE];
+
+    for (;;)
+    {
+        ssize_t const n = read(w->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN)
+        {
+            break;
+        }
+        if (n <= 0)
+        {
+            perror("inotify");
+            err = ERR_FILESYSTEM;
+            goto done;
+        }
+
+        for (char const *p = buf; p < &buf[n];)
+        {
+            struct inotify_event const *const event = (void const *)p;
+            p += sizeof(*event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                klog(LL_WARN, "Watch event queue overflowed, changes lost");
+                continue;
+            }
+
+            if (event->wd < 0 || (size_t)event->wd >= w->dirs.len ||
+                !w->dirs.ptr[event->wd])
+            {
+                continue;
+            }
+
+            if (event->mask & IN_IGNORED)
+            {
+                // Directory was removed
+                free(w->dirs.ptr[event->wd]);
+                w->dirs.ptr[event->wd] = NULL;
+                continue;
+            }
+
+            if (event->len == 0)
+            {
+                continue;
+            }
+
+            char *const path = watch_join(w->dirs.ptr[event->wd], event->name);
+            if (!path)
+            {
+                err = out_of_memory();
+                goto done;
+            }
+
+            if (event->mask & IN_ISDIR)
+            {
+                err = watch_add_tree(w, path, true);
+                if (err == ERR_FILESYSTEM)
+                {
+                    // Directory already gone
+                    err = OK;
+                }
+            }
+            else if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+            {
+                free(path);
+            }
+            else if (suppress && watch_events_find(&w->running, path))
+            {
+                klog(LL_DEBUG, "Ignoring own write to '%s'", path);
+                free(path);
+            }
+            else
+            {
+                err = watch_queue(w, path);
+            }
+
+            if (err)
+            {
+                goto done;
+            }
+        }
+    }
+
+done:
+    return err;
+}
+
+// Dispatch files whose debounce window has passed and wait for them
+static enum error watch_run_due(struct watch *const w)
+{
+    enum error err = OK;
+
+    u64 const now = watch_now_ms();
+
+    for (size_t i = 0; i < w->pending.len;)
+    {
+        struct watch_event const event = w->pending.ptr[i];
+
+        if (event.deadline > now)
+        {
+            ++i;
+            continue;
+        }
+
+        if (!watch_events_push(&w->running, event))
+        {
+            err = out_of_memory();
+            goto done;
+        }
+        w->pending.ptr[i] = w->pending.ptr[--w->pending.len];
+    }
+
+    if (w->running.len == 0)
+    {
+        goto done;
+    }
+
+    struct config const *const config = w->dispatch->config;
+
+    // Command failures are already reported and the watch goes on, but
+    // running out of memory is fatal
+    bool oom = false;
+    for (size_t i = 0; i < w->running.len; ++i)
+    {
+        char const *const path = w->running.ptr[i].path;
+        struct rule const *const rule =
+            config_match(config, sv_from_cstr(path));
+        if (rule && ERR_OUT_OF_MEMORY ==
+                        dispatch_matched(w->dispatch, rule, path))
+        {
+            oom = true;
+        }
+    }
+    if (ERR_OUT_OF_MEMORY == dispatch_finish(w->dispatch) || oom)
+    {
+        err = ERR_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    // The commands are done, so events for their writes are already queued
+    err = watch_read_events(w, true);
+
+done:
+    watch_events_clear(&w->running);
+    return err;
+}
+
+enum error watch_dispatch(
+    struct dispatch *const d,
+    char const *const root,
+    u64 const debounce_ms
+)
+{
+    assert(root);
+
+    enum error err = OK;
+
+    struct watch w = {
+        .dispatch = d,
+        .fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC),
+        .debounce_ms = debounce_ms,
+    };
+
+    if (w.fd < 0)
+    {
+        perror("inotify");
+        err = ERR_FILESYSTEM;
+        goto done;
+    }
+
+    char *const root_path = watch_join(".", root);
+    if (!root_path)
+    {
+        err = out_of_memory();
+        goto done;
+    }
+
+    err = watch_add_tree(&w, root_path, false);
+    if (err)
+    {
+        goto done;
+    }
+
+    klog(LL_INFO, "Watching '%s'", root);
+
+    for (;;)
+    {
+        int timeout = -1;
+        if (w.pending.len > 0)
+        {
+            u64 next = UINT64_MAX;
+            for (size_t i = 0; i < w.pending.len; ++i)
+            {
+                next = MIN(next, w.pending.ptr[i].deadline);
+            }
+
+            u64 const now = watch_now_ms();
+            timeout = next > now ? (int)(next - now) : 0;
+        }
+
+        struct pollfd pfd = {
+            .fd = w.fd,
+            .events = POLLIN,
+        };
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+        {
+            perror("poll");
+            err = ERR_FILESYSTEM;
+            goto done;
+        }
+
+        err = watch_read_events(&w, false);
+        if (err)
+        {
+            goto done;
+        }
+
+        err = watch_run_due(&w);
+        if (err)
+        {
+            goto done;
+        }
+    }
+
+done:
+    for (size_t i = 0; i < w.dirs.len; ++i)
+    {
+        free(w.dirs.ptr[i]);
+    }
+    watch_dirs_deinit(&w.dirs);
+    watch_events_clear(&w.pending);
+    watch_events_deinit(&w.pending);
+    watch_events_deinit(&w.running);
+    if (w.fd >= 0)
+    {
+        close(w.fd);
+    }
+    return err;
+}
+
+#else
+
+enum error watch_dispatch(
+    struct dispatch *const d,
+    char const *const root,
+    u64 const debounce_ms
+)
+{
+    (void)d;
+    (void)root;
+    (void)debounce_ms;
+
+    klog(LL_ERROR, "--watch is only supported on Linux");
+    return ERR_ARGS;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include "dispatch.h"
+#include "error.h"
+#include "krs_cc_ext.h"
+#include "krs_types.h"
+#include "prexy.h"
+#include <stddef.h>
+
+#define WATCH_DEFAULT_DEBOUNCE_MS 100
+
+// Directory path of each watch descriptor, NULL if unused (owned)
+prexy struct watch_dirs
+{
+    char **ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Changed file waiting to be dispatched
+struct watch_event
+{
+    char *path;
+    // Monotonic time in ms after which the file is dispatched
+    u64 deadline;
+};
+
+prexy struct watch_events
+{
+    struct watch_event *ptr;
+    size_t len;
+    size_t cap;
+};
+
+// Watch the tree under `root` and dispatch files that match a rule once
+// they have not been written for `debounce_ms`. Writes made by the
+// commands themselves are ignored. Only returns on error.
+nodiscard enum error watch_dispatch(
+    struct dispatch *d,
+    char const *root,
+    u64 debounce_ms
+);
+
+#endif
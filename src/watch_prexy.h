@@ -0,0 +1,52 @@
+#ifndef PREXY_CLIENT_WATCH_H_
+#define PREXY_CLIENT_WATCH_H_
+
+/* Generated by prexy from: watch.h */
+
+#include "prexy.h"
+
+// prexy struct watch_dirs
+// {
+//     char **ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define watch_dirs_X(F)                                                        \
+    F(simple, char **, ptr)                                                    \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define watch_dirs_FIELDTYPE_ptr char **
+#define watch_dirs_IS_MUT_PTR_ptr 1
+#define watch_dirs_IS_CONST_PTR_ptr 0
+#define watch_dirs_PTRTYPE_ptr char *
+#define watch_dirs_FIELDTYPE_len size_t
+#define watch_dirs_IS_MUT_PTR_len 0
+#define watch_dirs_IS_CONST_PTR_len 0
+#define watch_dirs_FIELDTYPE_cap size_t
+#define watch_dirs_IS_MUT_PTR_cap 0
+#define watch_dirs_IS_CONST_PTR_cap 0
+
+// prexy struct watch_events
+// {
+//     struct watch_event *ptr;
+//     size_t len;
+//     size_t cap;
+// };
+#define watch_events_X(F)                                                      \
+    F(simple, struct watch_event *, ptr)                                       \
+    F(simple, size_t, len)                                                     \
+    F(simple, size_t, cap)
+
+#define watch_events_FIELDTYPE_ptr struct watch_event *
+#define watch_events_IS_MUT_PTR_ptr 1
+#define watch_events_IS_CONST_PTR_ptr 0
+#define watch_events_PTRTYPE_ptr struct watch_event
+#define watch_events_FIELDTYPE_len size_t
+#define watch_events_IS_MUT_PTR_len 0
+#define watch_events_IS_CONST_PTR_len 0
+#define watch_events_FIELDTYPE_cap size_t
+#define watch_events_IS_MUT_PTR_cap 0
+#define watch_events_IS_CONST_PTR_cap 0
+
+#endif
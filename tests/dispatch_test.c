@@ -0,0 +1,130 @@
+// Dispatch files to several rules on a small job pool with `opts.usage` set,
+// and check that each rule's usage counts exactly the commands run for it.
+// Slots are reused, so a command charged to its slot's previous entry would
+// show up as a wrong count.
+
+#include "config.h"
+#include "dispatch.h"
+#include "error.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_JOBS 3
+#define TEST_FILES 40
+
+static char const test_config[] = "*.a : true %\n"
+                                  "*.b : true first % second\n"
+                                  "b?_*.c ; *.d : true %\n";
+
+static char const *const test_exts[] = {"a", "b", "c", "d", "a"};
+static size_t const test_ext_rules[] = {0, 1, 2, 2, 0};
+
+int main(void)
+{
+    int failures = 0;
+    bool have_config = false;
+    bool have_dispatch = false;
+    struct config config = {0};
+    struct dispatch d = {0};
+    size_t expected[3] = {0};
+
+    char path[] = "/tmp/fnmar_dispatch_test.XXXXXX";
+    int const fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+
+    FILE *const file = fdopen(fd, "w");
+    if (!file || fputs(test_config, file) < 0 || fclose(file) != 0)
+    {
+        perror(path);
+        ++failures;
+        goto done;
+    }
+
+    if (config_init_from_file(&config, path, (struct config_opts){0}))
+    {
+        fprintf(stderr, "Could not load config\n");
+        ++failures;
+        goto done;
+    }
+    have_config = true;
+
+    struct dispatch_opts const opts = {
+        .jobs = TEST_JOBS,
+        .usage = true,
+    };
+    if (dispatch_init(&d, &config, opts))
+    {
+        fprintf(stderr, "Could not start dispatch\n");
+        ++failures;
+        goto done;
+    }
+    have_dispatch = true;
+
+    size_t const ext_count = sizeof(test_exts) / sizeof(test_exts[0]);
+    for (size_t i = 0; i < TEST_FILES; ++i)
+    {
+        char filename[32];
+        snprintf(
+            filename,
+            sizeof(filename),
+            "b%lu_%lu.%s",
+            (unsigned long)(i % 10),
+            (unsigned long)i,
+            test_exts[i % ext_count]
+        );
+
+        if (dispatch_file(&d, filename))
+        {
+            fprintf(stderr, "Could not dispatch '%s'\n", filename);
+            ++failures;
+        }
+        ++expected[test_ext_rules[i % ext_count]];
+    }
+
+    if (dispatch_finish(&d))
+    {
+        fprintf(stderr, "Commands did not all succeed\n");
+        ++failures;
+    }
+
+    for (size_t i = 0; i < d.usages.len; ++i)
+    {
+        printf(
+            "Rule %lu: %llu commands\n",
+            (unsigned long)i,
+            (unsigned long long)d.usages.ptr[i].count
+        );
+
+        if (d.usages.ptr[i].count != expected[i])
+        {
+            fprintf(
+                stderr,
+                "Rule %lu ran %lu commands, usage counted %llu\n",
+                (unsigned long)i,
+                (unsigned long)expected[i],
+                (unsigned long long)d.usages.ptr[i].count
+            );
+            ++failures;
+        }
+    }
+
+done:
+    if (have_dispatch)
+    {
+        dispatch_deinit(&d);
+    }
+    if (have_config)
+    {
+        config_deinit(&config);
+    }
+    unlink(path);
+    return failures ? 1 : 0;
+}
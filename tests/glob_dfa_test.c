@@ -0,0 +1,197 @@
+// Build automata for random pattern sets, tagging each pattern with its rule
+// index as `config_build_dfa()` does, and check that every name gets the
+// lowest rule that `fnmatch(pattern, name, 0)` matches.
+
+#include "glob_dfa.h"
+#include "glob_dfa_prexy.h"
+#include "krs_str.h"
+#include "krs_types.h"
+#include "prexy.h"
+
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define Vec glob_dfa_patterns
+#include "krs_vec.inc.h"
+
+#define TEST_SEED 0x9e3779b97f4a7c15u
+#define TEST_SETS 2000
+#define TEST_NAMES_PER_SET 200
+#define TEST_MAX_RULES 6
+#define TEST_PATTERN_SIZE 32
+#define TEST_NAME_SIZE 16
+#define TEST_MAX_STATES 4096
+
+static u64 rng_state = TEST_SEED;
+
+static u64 rng_next(void)
+{
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rng_below(size_t const n)
+{
+    return (size_t)(rng_next() % n);
+}
+
+static char rng_pick(char const *const chars)
+{
+    return chars[rng_below(strlen(chars))];
+}
+
+// Append a random pattern element to `buf`, leaving room for a NUL
+static size_t gen_pattern(char *const buf, size_t const size)
+{
+    static char const *const pieces[] = {
+        "*", "?", "[ab]", "[!a]", "[a-c]", "[]a]", "[!]]", "[.-/]", "\\*",
+        "\\a", "[", "]", "-", "!",
+    };
+    size_t const piece_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    size_t len = 0;
+    size_t const count = rng_below(6);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        char const *piece;
+        char literal[2] = {0};
+
+        if (rng_below(2))
+        {
+            literal[0] = rng_pick("ab.c/");
+            piece = literal;
+        }
+        else
+        {
+            piece = pieces[rng_below(piece_count)];
+        }
+
+        size_t const piece_len = strlen(piece);
+        if (len + piece_len >= size)
+        {
+            break;
+        }
+        memcpy(&buf[len], piece, piece_len);
+        len += piece_len;
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+static size_t gen_name(char *const buf, size_t const size)
+{
+    size_t const len = rng_below(size - 1);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        buf[i] = rng_pick("abc./-]*\\");
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+int main(void)
+{
+    int failures = 0;
+    size_t built = 0;
+
+    char patterns_buf[TEST_MAX_RULES][TEST_PATTERN_SIZE];
+
+    for (size_t set = 0; set < TEST_SETS && failures < 10; ++set)
+    {
+        struct glob_dfa_patterns patterns = {0};
+        size_t const rule_count = 1 + rng_below(TEST_MAX_RULES);
+
+        for (size_t i = 0; i < rule_count; ++i)
+        {
+            size_t const len = gen_pattern(patterns_buf[i], TEST_PATTERN_SIZE);
+            struct glob_dfa_pattern const pattern = {
+                .pattern = {.ptr = patterns_buf[i], .len = len},
+                .tag = (u32)i,
+            };
+
+            if (!glob_dfa_patterns_push(&patterns, pattern))
+            {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+        }
+
+        struct glob_dfa dfa = {0};
+        if (glob_dfa_build(&dfa, patterns, TEST_MAX_STATES))
+        {
+            fprintf(stderr, "Could not build automaton\n");
+            return 1;
+        }
+
+        // Unsupported or too large sets fall back to scanning in fnmar
+        if (dfa.state_count > 0)
+        {
+            ++built;
+        }
+
+        for (size_t n = 0; dfa.state_count > 0 && n < TEST_NAMES_PER_SET;
+             ++n)
+        {
+            char name[TEST_NAME_SIZE];
+            size_t const name_len = gen_name(name, sizeof(name));
+
+            u32 expected = GLOB_DFA_NO_MATCH;
+            for (size_t i = 0; i < rule_count; ++i)
+            {
+                if (0 == fnmatch(patterns_buf[i], name, 0))
+                {
+                    expected = (u32)i;
+                    break;
+                }
+            }
+
+            struct sv const name_sv = {.ptr = name, .len = name_len};
+            u32 const tag = glob_dfa_match(&dfa, name_sv);
+
+            if (tag != expected)
+            {
+                fprintf(
+                    stderr,
+                    "Name '%s' matched rule %ld, fnmatch expects %ld:\n",
+                    name,
+                    tag == GLOB_DFA_NO_MATCH ? -1L : (long)tag,
+                    expected == GLOB_DFA_NO_MATCH ? -1L : (long)expected
+                );
+                for (size_t i = 0; i < rule_count; ++i)
+                {
+                    fprintf(
+                        stderr,
+                        "  %lu: '%s'\n",
+                        (unsigned long)i,
+                        patterns_buf[i]
+                    );
+                }
+                ++failures;
+                break;
+            }
+        }
+
+        glob_dfa_deinit(&dfa);
+        glob_dfa_patterns_deinit(&patterns);
+    }
+
+    printf("%lu of %d pattern sets built\n", (unsigned long)built, TEST_SETS);
+
+    if (built == 0)
+    {
+        fprintf(stderr, "No automaton was built\n");
+        ++failures;
+    }
+
+    return failures ? 1 : 0;
+}
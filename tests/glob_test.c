@@ -0,0 +1,155 @@
+// Compile random patterns with `glob_compile()` and check that
+// `glob_match()` agrees with `fnmatch(pattern, name, 0)` on random names.
+// Runs in the C locale, as `glob_compile()` assumes.
+
+#include "krs_glob.h"
+#include "krs_str.h"
+#include "krs_types.h"
+
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_SEED 0x2545f4914f6cdd1du
+#define TEST_PATTERNS 20000
+#define TEST_NAMES_PER_PATTERN 100
+#define TEST_PATTERN_SIZE 48
+#define TEST_NAME_SIZE 16
+
+static u64 rng_state = TEST_SEED;
+
+static u64 rng_next(void)
+{
+    // xorshift64
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rng_below(size_t const n)
+{
+    return (size_t)(rng_next() % n);
+}
+
+static char rng_pick(char const *const chars)
+{
+    return chars[rng_below(strlen(chars))];
+}
+
+static size_t gen_pattern(char *const buf, size_t const size)
+{
+    static char const *const pieces[] = {
+        "*",          "**",         "?",        "[ab]",      "[!a]",
+        "[^a]",       "[a-c]",      "[c-a]",    "[]a]",      "[!]]",
+        "[a-]",       "[.-/]",      "\\*",      "\\?",       "\\[",
+        "\\",         "[",          "]",        "[!",        "[\\]]",
+        "[[:alpha:]]", "[[:digit:]]", "[![:space:]]", "[[:punct:]a]",
+        "[[:bogus:]]", "[[.a.]]",   "[[=a=]]",  "[[.-.]]",   "[\x80-\xff]",
+    };
+    size_t const piece_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    size_t len = 0;
+    size_t const count = rng_below(8);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        char const *piece;
+        char literal[2] = {0};
+
+        if (rng_below(2))
+        {
+            literal[0] = rng_pick("ab.c/1 ]-");
+            piece = literal;
+        }
+        else
+        {
+            piece = pieces[rng_below(piece_count)];
+        }
+
+        size_t const piece_len = strlen(piece);
+        if (len + piece_len >= size)
+        {
+            break;
+        }
+        memcpy(&buf[len], piece, piece_len);
+        len += piece_len;
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+static size_t gen_name(char *const buf, size_t const size)
+{
+    size_t const len = rng_below(size - 1);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        buf[i] = rng_pick("abc1./- ]*?[\\\x80\xff");
+    }
+
+    buf[len] = '\0';
+    return len;
+}
+
+int main(void)
+{
+    int failures = 0;
+    size_t supported = 0;
+
+    struct glob_atom atoms[TEST_PATTERN_SIZE];
+
+    for (size_t p = 0; p < TEST_PATTERNS && failures < 10; ++p)
+    {
+        char pattern[TEST_PATTERN_SIZE];
+        size_t const pattern_len = gen_pattern(pattern, sizeof(pattern));
+        struct sv const pattern_sv = {.ptr = pattern, .len = pattern_len};
+
+        size_t atom_count;
+        if (!glob_compile(pattern_sv, atoms, &atom_count))
+        {
+            continue;
+        }
+        ++supported;
+
+        for (size_t n = 0; n < TEST_NAMES_PER_PATTERN; ++n)
+        {
+            char name[TEST_NAME_SIZE];
+            size_t const name_len = gen_name(name, sizeof(name));
+            struct sv const name_sv = {.ptr = name, .len = name_len};
+
+            bool const expected = 0 == fnmatch(pattern, name, 0);
+            bool const found = glob_match(atoms, atom_count, name_sv);
+
+            if (found != expected)
+            {
+                fprintf(
+                    stderr,
+                    "Pattern '%s' %s name '%s', fnmatch disagrees\n",
+                    pattern,
+                    found ? "matched" : "did not match",
+                    name
+                );
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    printf(
+        "%lu of %d patterns supported\n",
+        (unsigned long)supported,
+        TEST_PATTERNS
+    );
+
+    if (supported == 0)
+    {
+        fprintf(stderr, "No pattern was supported\n");
+        ++failures;
+    }
+
+    return failures ? 1 : 0;
+}
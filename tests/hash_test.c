@@ -0,0 +1,110 @@
+// Check SHA-256 against the FIPS 180-2 example digests, hashing in uneven
+// pieces to cross block boundaries
+
+#include "krs_hash.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct hash_case
+{
+    char const *input;
+    size_t repeat;
+    char const *digest;
+};
+
+static struct hash_case const hash_cases[] = {
+    {
+        "",
+        1,
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+    },
+    {
+        "abc",
+        1,
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+    },
+    {
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        1,
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+    },
+    {
+        "a",
+        1000000,
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+    },
+};
+
+int main(void)
+{
+    int failures = 0;
+
+    for (size_t i = 0; i < sizeof(hash_cases) / sizeof(hash_cases[0]); ++i)
+    {
+        struct hash_case const c = hash_cases[i];
+        size_t const len = strlen(c.input);
+
+        struct hash_sha256 h;
+        hash_sha256_init(&h);
+
+        // Alternate piece sizes so pieces straddle blocks
+        for (size_t r = 0; r < c.repeat;)
+        {
+            size_t const n = (r % 3 == 0) ? 1 : 7;
+            for (size_t j = 0; j < n && r < c.repeat; ++j, ++r)
+            {
+                hash_sha256_update(&h, c.input, len);
+            }
+        }
+
+        unsigned char digest[HASH_SHA256_SIZE];
+        hash_sha256_final(&h, digest);
+
+        char hex[HASH_SHA256_SIZE * 2 + 1];
+        for (size_t j = 0; j < HASH_SHA256_SIZE; ++j)
+        {
+            snprintf(&hex[j * 2], 3, "%02x", digest[j]);
+        }
+
+        if (0 != strcmp(hex, c.digest))
+        {
+            fprintf(stderr, "Case %lu: got %s\n", (unsigned long)i, hex);
+            ++failures;
+        }
+    }
+
+    // The million-'a' case again in large pieces, which skip the block
+    // buffer when it is empty
+    static char chunk[1000];
+    memset(chunk, 'a', sizeof(chunk));
+
+    struct hash_sha256 h;
+    hash_sha256_init(&h);
+    hash_sha256_update(&h, chunk, 1);
+    for (size_t i = 0; i < 999; ++i)
+    {
+        hash_sha256_update(&h, chunk, sizeof(chunk));
+    }
+    hash_sha256_update(&h, chunk, sizeof(chunk) - 1);
+
+    unsigned char digest[HASH_SHA256_SIZE];
+    hash_sha256_final(&h, digest);
+
+    unsigned char expected[HASH_SHA256_SIZE];
+    char const *const hex = hash_cases[3].digest;
+    for (size_t j = 0; j < HASH_SHA256_SIZE; ++j)
+    {
+        unsigned byte;
+        (void)!sscanf(&hex[j * 2], "%2x", &byte);
+        expected[j] = (unsigned char)byte;
+    }
+
+    if (0 != memcmp(digest, expected, sizeof(digest)))
+    {
+        fprintf(stderr, "Large pieces: digest differs\n");
+        ++failures;
+    }
+
+    return failures ? 1 : 0;
+}